@@ -0,0 +1,151 @@
+#! /usr/bin/env python
+
+"""Generator of synthetic benchmark data for prophasm.
+
+    gen_data.py genome -n SIZE [-s SEED]
+        random genome of SIZE nucleotides
+    gen_data.py mutate -r RATE [-s SEED] genome.fa
+        strain with RATE substitutions per nucleotide (and RATE/10 short indels)
+    gen_data.py reads -c COVERAGE -l LENGTH -e ERROR_RATE [-s SEED] genome.fa
+        reads sampled uniformly from both strands, with sequencing errors
+        (as in mutate)
+
+The sequences are written to standard output in FASTA. For a given seed,
+the output is the same for all Python versions.
+
+Author: Karel Brinda <kbrinda@hsph.harvard.edu>
+
+Licence: MIT
+"""
+
+import argparse
+import sys
+
+NTS = "ACGT"
+COMP = {"A": "T", "C": "G", "G": "C", "T": "A"}
+LINE_LENGTH = 60
+
+
+class Rng(object):
+    """Xorshift64* generator (independent of the random module of Python)."""
+
+    def __init__(self, seed):
+        self.x = (seed * 0x9E3779B97F4A7C15 + 1) & 0xFFFFFFFFFFFFFFFF
+
+    def next(self):
+        x = self.x
+        x ^= x >> 12
+        x ^= (x << 25) & 0xFFFFFFFFFFFFFFFF
+        x ^= x >> 27
+        self.x = x
+        return (x * 0x2545F4914F6CDD1D) & 0xFFFFFFFFFFFFFFFF
+
+    def below(self, n):
+        return self.next() % n
+
+    def uniform(self):
+        return (self.next() >> 11) / float(1 << 53)
+
+
+def random_sequence(rng, n):
+    chunks = []
+    while n > 0:
+        # 32 nucleotides per random number
+        x = rng.next()
+        m = min(n, 32)
+        chunks.append("".join(NTS[(x >> (2 * i)) & 3] for i in range(m)))
+        n -= m
+    return "".join(chunks)
+
+
+def load_fasta(fn):
+    seqs = []
+    with open(fn) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith(">"):
+                seqs.append([])
+            elif line:
+                seqs[-1].append(line.upper())
+    return ["".join(s) for s in seqs]
+
+
+def write_fasta(name, seq):
+    sys.stdout.write(">{}\n".format(name))
+    for i in range(0, len(seq), LINE_LENGTH):
+        sys.stdout.write(seq[i:i + LINE_LENGTH])
+        sys.stdout.write("\n")
+
+
+def reverse_complement(seq):
+    return "".join(COMP.get(c, "N") for c in reversed(seq))
+
+
+def mutate(rng, seq, rate):
+    seq = list(seq)
+    n = len(seq)
+    # geometric gaps between mutations
+    i = 0
+    while rate > 0:
+        i += 1 + int(rng.uniform() * 2.0 / rate)
+        if i >= n:
+            break
+        if rng.below(11) == 0:
+            if rng.below(2) == 0:
+                seq[i] = ""
+            else:
+                seq[i] += random_sequence(rng, 1 + rng.below(3))
+        else:
+            seq[i] = NTS[(NTS.index(seq[i]) + 1 + rng.below(3)) % 4] if seq[i] in NTS else seq[i]
+    return "".join(seq)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Synthetic data for prophasm benchmarks.")
+    subparsers = parser.add_subparsers(dest="command")
+
+    p = subparsers.add_parser("genome")
+    p.add_argument("-n", type=int, required=True, metavar="SIZE")
+    p.add_argument("-s", type=int, default=1, metavar="SEED")
+
+    p = subparsers.add_parser("mutate")
+    p.add_argument("-r", type=float, required=True, metavar="RATE")
+    p.add_argument("-s", type=int, default=1, metavar="SEED")
+    p.add_argument("fasta")
+
+    p = subparsers.add_parser("reads")
+    p.add_argument("-c", type=float, required=True, metavar="COVERAGE")
+    p.add_argument("-l", type=int, default=100, metavar="LENGTH")
+    p.add_argument("-e", type=float, default=0.0, metavar="ERROR_RATE")
+    p.add_argument("-s", type=int, default=1, metavar="SEED")
+    p.add_argument("fasta")
+
+    args = parser.parse_args()
+    if args.command is None:
+        parser.print_help()
+        sys.exit(1)
+
+    rng = Rng(args.s)
+
+    if args.command == "genome":
+        write_fasta("genome", random_sequence(rng, args.n))
+
+    elif args.command == "mutate":
+        for j, seq in enumerate(load_fasta(args.fasta)):
+            write_fasta("strain_{}".format(j), mutate(rng, seq, args.r))
+
+    elif args.command == "reads":
+        seq = "".join(load_fasta(args.fasta))
+        no_reads = int(args.c * len(seq) / args.l)
+        for j in range(no_reads):
+            start = rng.below(len(seq) - args.l + 1)
+            read = seq[start:start + args.l]
+            if rng.below(2) == 1:
+                read = reverse_complement(read)
+            if args.e > 0:
+                read = mutate(rng, read, args.e)
+            write_fasta("read_{}".format(j), read)
+
+
+if __name__ == "__main__":
+    main()
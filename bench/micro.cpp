@@ -0,0 +1,343 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Micro-benchmarks of the k-mer kernels of prophasm on random sequences:
+	k-mer encoding (also with k fixed at compile time for k = 15, 21, 25
+	and 31), nucleotide encoding by the table nt256_nt4 and by comparisons
+	(on mixed-case sequences with N), insertion and lookup, intersection,
+	subtraction and their fused variant (with hash sets and sorted arrays)
+	and assembly.
+
+	Usage: micro <k> <sequence length> <threads>
+
+	The results are printed in the format of the '# phase' records of the
+	-s statistics file (stats.h).
+*/
+
+#include "../src/engine.h"
+#include "../src/stats.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace prophasm::engine;
+
+
+/* sequence with a = reference (a random genome), b = half shared with a */
+void random_sequences(size_t length, std::string &a, std::string &b){
+	uint64_t x=0x9E3779B97F4A7C15ULL;
+	auto next_nt=[&](){
+		x^=x >> 12;
+		x^=x << 25;
+		x^=x >> 27;
+		return "ACGT"[(x*0x2545F4914F6CDD1DULL) >> 62];
+	};
+	a.resize(length);
+	for(char &c : a){
+		c=next_nt();
+	}
+	b=a.substr(0, length/2);
+	while(b.size()<length){
+		b.push_back(next_nt());
+	}
+}
+
+/* copy of a sequence with every other block of 1000 bases in lowercase and 0.1% N */
+std::string mixed_case_with_n(const std::string &seq){
+	std::string mixed(seq);
+	for(size_t i=0;i<mixed.size();i++){
+		if((i/1000)%2==1){
+			mixed[i]=tolower(mixed[i]);
+		}
+		if(i%1000==999){
+			mixed[i]='N';
+		}
+	}
+	return mixed;
+}
+
+/* nucleotide encoding by comparisons, the alternative to the table nt256_nt4 */
+inline uint8_t nt4_scalar(char c){
+	switch(c){
+		case 'A': case 'a': return 0;
+		case 'C': case 'c': return 1;
+		case 'G': case 'g': return 2;
+		case 'T': case 't': return 3;
+		default: return 4;
+	}
+}
+
+template<typename _set_T>
+void kmers_of(const std::string &seq, int32_t k, _set_T &set){
+	kmer_iterator_t<typename _set_T::value_type> it(seq.data(), seq.size(), k);
+	while(it.next()){
+		set.insert(it.canonical());
+	}
+}
+
+/* occupancy of a hash table (none for sorted sets) */
+template<typename _set_T>
+table_stats_t table_stats(const _set_T &set){
+	table_stats_t tables;
+	tables.size=set.size();
+	tables.capacity=set.capacity();
+	set.add_probe_lengths(tables.probe_lengths);
+	return tables;
+}
+
+template<typename _nkmer_T>
+table_stats_t table_stats(const sorted_kmer_set_t<_nkmer_T> &/*set*/){
+	return table_stats_t();
+}
+
+/* length with an optional suffix K, M or G (powers of 1024) */
+int64_t parse_length(const char *s){
+	char *end=nullptr;
+	const int64_t value=strtoll(s, &end, 10);
+	switch(toupper(*end)){
+		case '\0': return value;
+		case 'K': return value << 10;
+		case 'M': return value << 20;
+		case 'G': return value << 30;
+		default: return -1;
+	}
+}
+
+
+/*
+	Kernels with k given either at runtime (int32_t) or at compile time
+	(std::integral_constant), to measure what specializing them by k would
+	gain. Both variants run the same code as kmer_iterator_t and
+	encode_canonical.
+*/
+template<typename _nkmer_T, typename _k_T>
+uint64_t iterate_canonical(const std::string &seq, _k_T k){
+	const _nkmer_T mask=kmer_mask<_nkmer_T>(k);
+	_nkmer_T nkmer_f=0;
+	_nkmer_T nkmer_r=0;
+	int32_t valid=0;
+	uint64_t checksum=0;
+	for(const char c : seq){
+		const uint8_t nt4=nt256_nt4[static_cast<uint8_t>(c)];
+		if(nt4==4){
+			valid=0;
+			continue;
+		}
+		nkmer_f=((nkmer_f<<2) | nt4) & mask;
+		nkmer_r=(nkmer_r>>2) | (_nkmer_T(3-nt4) << (2*(k-1)));
+		if(valid<k){
+			valid++;
+		}
+		if(valid==k){
+			checksum+=static_cast<uint64_t>(std::min(nkmer_f, nkmer_r));
+		}
+	}
+	return checksum;
+}
+
+template<typename _nkmer_T, typename _k_T>
+uint64_t encode_all_canonical(const std::string &seq, _k_T k){
+	uint64_t checksum=0;
+	for(size_t i=0;i+k<=seq.size();i++){
+		_nkmer_T nkmer;
+		if(encode_canonical(seq.data()+i, k, nkmer)==0){
+			checksum+=static_cast<uint64_t>(nkmer);
+		}
+	}
+	return checksum;
+}
+
+template<typename _nkmer_T, int32_t _k>
+void bench_fixed_k(const std::string &seq, uint64_t no_kmers, uint64_t &checksum){
+	const std::integral_constant<int32_t,_k> fixed_k;
+
+	phase_timer_t timer;
+	checksum+=iterate_canonical<_nkmer_T>(seq, int32_t(_k));
+	timer.print(stdout, "kmer_iterator.runtime_k", no_kmers);
+
+	timer.restart();
+	checksum+=iterate_canonical<_nkmer_T>(seq, fixed_k);
+	timer.print(stdout, "kmer_iterator.fixed_k", no_kmers);
+
+	timer.restart();
+	checksum+=encode_all_canonical<_nkmer_T>(seq, int32_t(_k));
+	timer.print(stdout, "encode_canonical.runtime_k", no_kmers);
+
+	timer.restart();
+	checksum+=encode_all_canonical<_nkmer_T>(seq, fixed_k);
+	timer.print(stdout, "encode_canonical.fixed_k", no_kmers);
+}
+
+/* dispatch of the common values of k (other k are not compared) */
+template<typename _nkmer_T>
+void bench_fixed_k(int32_t k, const std::string &seq, uint64_t no_kmers, uint64_t &checksum){
+	switch(k){
+		case 15: bench_fixed_k<_nkmer_T,15>(seq, no_kmers, checksum); break;
+		case 21: bench_fixed_k<_nkmer_T,21>(seq, no_kmers, checksum); break;
+		case 25: bench_fixed_k<_nkmer_T,25>(seq, no_kmers, checksum); break;
+		case 31: bench_fixed_k<_nkmer_T,31>(seq, no_kmers, checksum); break;
+		default: break;
+	}
+}
+
+
+template<typename _nkmer_T, typename _set_T>
+void bench_set_operations(const char *container, const std::vector<_set_T> &input_sets, int32_t threads, uint64_t &checksum){
+	std::vector<_set_T> sets(input_sets);
+	_set_T intersection;
+
+	phase_timer_t timer;
+	find_intersection(sets, intersection, threads);
+	timer.print(stdout, (std::string("find_intersection.")+container).c_str(), sets[0].size()+sets[1].size(), table_stats(intersection));
+
+	timer.restart();
+	remove_subset(sets, intersection, threads);
+	timer.print(stdout, (std::string("remove_subset.")+container).c_str(), 2*intersection.size(), table_stats(sets[0]));
+
+	checksum+=intersection.size()+sets[0].size()+sets[1].size();
+
+	sets=input_sets;
+	timer.restart();
+	extract_intersection(sets, intersection, threads);
+	timer.print(stdout, (std::string("extract_intersection.")+container).c_str(), input_sets[0].size()+input_sets[1].size(), table_stats(intersection));
+
+	checksum+=intersection.size()+sets[0].size()+sets[1].size();
+}
+
+
+template<typename _nkmer_T>
+void bench(int32_t k, size_t length, int32_t threads){
+	std::string a, b;
+	random_sequences(length, a, b);
+	const uint64_t no_kmers=length-k+1;
+	uint64_t checksum=0;
+
+	phase_timer_t timer;
+	for(size_t i=0;i+k<=a.size();i++){
+		_nkmer_T nkmer;
+		if(encode_canonical(a.data()+i, k, nkmer)==0){
+			checksum+=static_cast<uint64_t>(nkmer);
+		}
+	}
+	timer.print(stdout, "encode_canonical", no_kmers);
+
+	timer.restart();
+	kmer_iterator_t<_nkmer_T> it(a.data(), a.size(), k);
+	while(it.next()){
+		checksum+=static_cast<uint64_t>(it.canonical());
+	}
+	timer.print(stdout, "kmer_iterator", no_kmers);
+
+	bench_fixed_k<_nkmer_T>(k, a, no_kmers, checksum);
+
+	/* nucleotide encoding of mixed-case sequences with N */
+	const std::string mixed=mixed_case_with_n(a);
+	timer.restart();
+	for(const char c : mixed){
+		checksum+=nt256_nt4[static_cast<uint8_t>(c)];
+	}
+	timer.print(stdout, "encode_nt4.table", mixed.size());
+
+	timer.restart();
+	for(const char c : mixed){
+		checksum+=nt4_scalar(c);
+	}
+	timer.print(stdout, "encode_nt4.scalar", mixed.size());
+
+	timer.restart();
+	uint64_t no_mixed_kmers=0;
+	kmer_iterator_t<_nkmer_T> it_mixed(mixed.data(), mixed.size(), k);
+	while(it_mixed.next()){
+		checksum+=static_cast<uint64_t>(it_mixed.canonical());
+		no_mixed_kmers++;
+	}
+	timer.print(stdout, "kmer_iterator.mixed", no_mixed_kmers);
+
+	std::vector< partitioned_kmer_set_t<_nkmer_T> > sets(2);
+	timer.restart();
+	kmers_of(a, k, sets[0]);
+	timer.print(stdout, "insert", no_kmers, table_stats(sets[0]));
+	kmers_of(b, k, sets[1]);
+
+	timer.restart();
+	kmer_iterator_t<_nkmer_T> it_b(b.data(), b.size(), k);
+	while(it_b.next()){
+		checksum+=sets[0].count(it_b.canonical());
+	}
+	timer.print(stdout, "lookup", no_kmers, table_stats(sets[0]));
+
+	std::vector< sorted_kmer_set_t<_nkmer_T> > sorted_sets(2);
+	timer.restart();
+	for(size_t i=0;i<sets.size();i++){
+		sorted_kmer_set_from(sets[i], sorted_sets[i], k, threads);
+	}
+	timer.print(stdout, "sort", sets[0].size()+sets[1].size());
+
+	bench_set_operations<_nkmer_T>("hash", sets, threads, checksum);
+	bench_set_operations<_nkmer_T>("sorted", sorted_sets, threads, checksum);
+
+	timer.restart();
+	const uint64_t no_set_kmers=sets[0].size();
+	assemble_simplitigs(sets[0], k, [&](const char *, size_t len){ checksum+=len; });
+	timer.print(stdout, "assemble", no_set_kmers);
+
+	/* keep the results alive */
+	std::cerr << "checksum: " << checksum << std::endl;
+}
+
+
+int main(int argc, char* argv[]){
+	if(argc!=4){
+		std::cerr << "Usage: " << argv[0] << " <k> <sequence length> <threads>" << std::endl;
+		return 1;
+	}
+	const int32_t k=atoi(argv[1]);
+	const int64_t length=parse_length(argv[2]);
+	const int32_t threads=atoi(argv[3]);
+	if(k<1 || k>max_allowed_kmer_length || length<k || threads<1){
+		std::cerr << "Error: invalid parameters." << std::endl;
+		return 1;
+	}
+
+	if(k<=32){
+		bench<kmer_word<64>::type>(k, length, threads);
+	}
+	else if(k<=64){
+		bench<kmer_word<128>::type>(k, length, threads);
+	}
+	else{
+		bench<kmer_word<256>::type>(k, length, threads);
+	}
+
+	return 0;
+}
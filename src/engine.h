@@ -0,0 +1,1167 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	The k-mer engine of prophasm, shared by the command-line tool
+	(prophasm.cpp) and the library (libprophasm.cpp): k-mer encoding,
+	loading of FASTA files and binary k-mer sets, set operations and the
+	greedy assembly of simplitigs.
+
+	The engine does not terminate the program: the loaders return LOAD_*
+	error codes (load_error_message), which the command-line tool reports
+	as fatal errors and the library returns to the caller.
+*/
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "kseq.h"
+#include "input.h"
+#include "kmer_counter.h"
+#include "kmer_dump.h"
+#include "kmer_set.h"
+#include "kmer_word.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "sorted_kmer_set.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+KSEQ_INIT(input_t*, input_read)
+
+
+namespace prophasm{
+namespace engine{
+
+const int32_t max_allowed_kmer_length=sizeof(kmer_word<256>::type)*4;
+
+/* multithreaded loading: max nucleotides per chunk, per batch, and k-mers buffered per partition */
+const int64_t load_chunk_length=1<<20;
+const int64_t load_batch_length=1<<22;
+const size_t load_flush_size=1024;
+
+static const uint8_t nt4_nt256[] = "ACGTN";
+
+static const uint8_t nt256_nt4[] = {
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 0, 4, 1,  4, 4, 4, 2,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 0, 4, 1,  4, 4, 4, 2,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4
+	};
+
+/*
+	Reverse complement of an encoded k-mer, computed on the whole word (no
+	loop over k): the complemented word is reversed by 2-bit groups
+	(kmer_word.h) and the k-mer shifted back to the lowest bits.
+*/
+template<typename _nkmer_T>
+_nkmer_T reverse_complement_kmer(const _nkmer_T &nkmer, int32_t k){
+	const int32_t bits=8*sizeof(_nkmer_T);
+	if(k<=0){
+		return _nkmer_T(0);
+	}
+	return reverse_nucleotides(~nkmer) >> (bits-2*k);
+}
+
+template<typename _nkmer_T>
+int32_t encode_forward(const char *kmers, const int32_t k, _nkmer_T &nkmer){
+	nkmer=0;
+	for (int32_t i=0;i<k;i++){
+		uint8_t nt4 = nt256_nt4[static_cast<int32_t>(kmers[i])];
+		if (nt4==4){
+			return -1;
+		}
+
+		nkmer <<= 2;
+		nkmer |= nt4;
+	}
+	return 0;
+}
+
+template<typename _nkmer_T>
+int32_t encode_reverse(const char *kmers, const int32_t k, _nkmer_T &nkmer){
+	_nkmer_T nkmer_f;
+	const int32_t error_code=encode_forward(kmers, k, nkmer_f);
+	if(error_code!=0){
+		return error_code;
+	}
+	nkmer=reverse_complement_kmer(nkmer_f, k);
+	return 0;
+}
+
+template<typename _nkmer_T>
+int32_t encode_canonical(const char *kmers, const int32_t k, _nkmer_T &nkmer){
+	_nkmer_T nkmer_f;
+
+	const int32_t error_code=encode_forward(kmers, k, nkmer_f);
+	if(error_code!=0){
+		return error_code;
+	}
+
+	nkmer=std::min(nkmer_f, reverse_complement_kmer(nkmer_f, k));
+
+	return 0;
+}
+
+/*
+	Mask of the 2k lowest bits.
+*/
+template<typename _nkmer_T>
+_nkmer_T kmer_mask(int32_t k){
+	const int32_t bits=8*sizeof(_nkmer_T);
+	return (~_nkmer_T(0)) >> (bits-2*k);
+}
+
+/*
+	Streaming iterator over the canonical k-mers of a sequence.
+
+	The forward and reverse-complement words are updated by a shift and a mask
+	for every new nucleotide (O(1) per position). After a non-ACGT character,
+	the window is restarted and no k-mer overlapping it is reported.
+
+	Usage:
+		kmer_iterator_t<nkmer_t> it(seq, len, k);
+		while(it.next()){
+			... it.canonical(), it.pos ...
+		}
+*/
+template<typename _nkmer_T>
+struct kmer_iterator_t{
+	int32_t k;
+
+	/* sequence */
+	const char *seq;
+	int64_t len;
+
+	/* position of the first nucleotide of the current k-mer */
+	int64_t pos;
+
+	/* next nucleotide to be read */
+	int64_t next_pos;
+
+	/* number of valid nucleotides in the current window */
+	int32_t valid;
+
+	_nkmer_T nkmer_f;
+	_nkmer_T nkmer_r;
+	_nkmer_T mask;
+
+	/* complement of each nucleotide at the highest position of the k-mer */
+	_nkmer_T high_complement[4];
+
+	kmer_iterator_t(const char *_seq, int64_t _len, int32_t _k):
+		k(_k), seq(_seq), len(_len), pos(-1), next_pos(0), valid(0),
+		nkmer_f(0), nkmer_r(0), mask(kmer_mask<_nkmer_T>(_k))
+	{
+		for(int32_t nt4=0;nt4<4;nt4++){
+			high_complement[nt4]=_nkmer_T(3-nt4) << (2*(k-1));
+		}
+	}
+
+	/* Move to the next valid k-mer. Return false at the end of the sequence. */
+	bool next(){
+		while(next_pos<len){
+			const uint8_t nt4 = nt256_nt4[static_cast<uint8_t>(seq[next_pos++])];
+			if (nt4==4){
+				valid=0;
+				continue;
+			}
+
+			nkmer_f=((nkmer_f<<2) | nt4) & mask;
+			nkmer_r=(nkmer_r>>2) | high_complement[nt4];
+
+			if(valid<k){
+				valid++;
+			}
+			if(valid==k){
+				pos=next_pos-k;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/* Continue the current sequence by another segment (e.g., the next line). */
+	void resume(const char *_seq, int64_t _len){
+		seq=_seq;
+		len=_len;
+		next_pos=0;
+	}
+
+	/* Start a new sequence. */
+	void reset(){
+		valid=0;
+	}
+
+	_nkmer_T canonical() const {
+		return std::min(nkmer_f,nkmer_r);
+	}
+};
+
+template<typename _nkmer_T>
+int32_t decode_kmer(_nkmer_T nkmer, int32_t k, std::string &kmer){
+	kmer.resize(k);
+	for(int32_t i=0;i<k;i++){
+		uint8_t nt4 = static_cast<uint64_t>(nkmer & _nkmer_T(0x3));
+		nkmer >>=2;
+		kmer[k-i-1]=nt4_nt256[nt4];
+	}
+
+	return 0;
+}
+
+template<typename _set_T>
+void debug_print_kmer_set(_set_T &set, int k, bool verbose){
+	std::string kmer;
+	for(auto x: set){
+		decode_kmer(x, k, kmer);
+		if(verbose){
+			std::cerr << x << " " << kmer << ";  ";
+		}
+	}
+	if(verbose){
+		std::cerr<<std::endl;
+	}
+}
+
+
+/*
+	Contig under construction, extended at both ends. The buffer grows
+	geometrically (the contig is re-centered), so memory is proportional to
+	the longest contig and extensions are amortized O(1) in both directions.
+*/
+struct contig_t{
+	int32_t k;
+
+	/* contig buffer */
+	std::vector<char> seq_buffer;
+
+	/* the first position of the contig */
+	size_t l_ext;
+
+	/* the last position of the contig +1 (semiopen) */
+	size_t r_ext;
+
+	contig_t(uint32_t _k):
+		k(_k), seq_buffer(4*_k+1024), l_ext(0), r_ext(0)
+	{
+	}
+
+	int32_t new_contig(const char *base_kmer){
+		assert(static_cast<int32_t>(strlen(base_kmer))==k);
+
+		l_ext = r_ext = seq_buffer.size()/2;
+
+		for(int32_t i=0;i<k;i++){
+			r_extend(base_kmer[i]);
+		}
+		return 0;
+	}
+
+	int32_t r_extend(char c){
+		uint8_t nt4 = nt256_nt4[static_cast<int32_t>(c)];
+
+		if (nt4==4){
+			return -1;
+		}
+
+		if(r_ext==seq_buffer.size()){
+			grow();
+		}
+		seq_buffer[r_ext]=nt4_nt256[nt4];
+		++r_ext;
+		return 0;
+	}
+
+	int32_t l_extend(char c){
+		uint8_t nt4 = nt256_nt4[static_cast<int32_t>(c)];
+
+		if (nt4==4){
+			return -1;
+		}
+
+		if(l_ext==0){
+			grow();
+		}
+		--l_ext;
+		seq_buffer[l_ext]=nt4_nt256[3-nt4];
+		return 0;
+	}
+
+	const char *data() const {
+		return seq_buffer.data()+l_ext;
+	}
+
+	size_t size() const {
+		return r_ext-l_ext;
+	}
+
+private:
+	/* Double the buffer and center the contig in it. */
+	void grow(){
+		const size_t len=size();
+		std::vector<char> new_buffer(2*seq_buffer.size());
+		const size_t new_l_ext=(new_buffer.size()-len)/2;
+		std::copy(seq_buffer.begin()+l_ext, seq_buffer.begin()+r_ext, new_buffer.begin()+new_l_ext);
+		seq_buffer.swap(new_buffer);
+		l_ext=new_l_ext;
+		r_ext=new_l_ext+len;
+	}
+};
+
+
+/*
+	Insertion into a partitioned set from several threads: every worker
+	buffers its k-mers by partition of the set and inserts full buffers under
+	the partition's lock.
+*/
+template<typename _set_T>
+struct concurrent_inserter_t{
+	typedef typename _set_T::value_type nkmer_T;
+
+	_set_T &set;
+	std::vector<typename _set_T::partition_type *> partitions;
+	std::vector<std::mutex> locks;
+
+	concurrent_inserter_t(_set_T &_set):
+		set(_set), partitions(_set.no_partitions()), locks(_set.no_partitions())
+	{
+		for(size_t p=0;p<partitions.size();p++){
+			partitions[p]=&set.partition(p);
+		}
+	}
+
+	/* buffers of a single worker */
+	struct buffers_t{
+		concurrent_inserter_t &inserter;
+		std::vector< std::vector<nkmer_T> > buffers;
+
+		buffers_t(concurrent_inserter_t &_inserter):
+			inserter(_inserter), buffers(_inserter.partitions.size())
+		{}
+
+		~buffers_t(){
+			for(size_t p=0;p<buffers.size();p++){
+				if(!buffers[p].empty()){
+					flush(p);
+				}
+			}
+		}
+
+		void insert(const nkmer_T &nkmer){
+			const size_t p=inserter.set.partition_of(nkmer);
+			buffers[p].push_back(nkmer);
+			if(buffers[p].size()>=load_flush_size){
+				flush(p);
+			}
+		}
+
+		void flush(size_t p){
+			std::lock_guard<std::mutex> lock(inserter.locks[p]);
+			for(const nkmer_T &nkmer : buffers[p]){
+				inserter.partitions[p]->insert(nkmer);
+			}
+			buffers[p].clear();
+		}
+	};
+};
+
+
+/*
+	Multithreaded loading: the calling thread reads sequences, cuts them into
+	chunks overlapping by k-1 nucleotides and hands batches of chunks to the
+	workers.
+*/
+template<typename _set_T>
+int kmers_from_kseq_parallel(kseq_t *seq, _set_T &set, int32_t k, int32_t threads){
+	typedef typename _set_T::value_type nkmer_T;
+	typedef std::vector<std::string> batch_t;
+
+	concurrent_inserter_t<_set_T> inserter(set);
+	bounded_queue_t<batch_t> queue(2*threads);
+
+	auto worker=[&](){
+		typename concurrent_inserter_t<_set_T>::buffers_t buffers(inserter);
+
+		batch_t batch;
+		while(queue.pop(batch)){
+			for(const std::string &chunk : batch){
+				kmer_iterator_t<nkmer_T> it(chunk.data(), chunk.size(), k);
+				while(it.next()){
+					buffers.insert(it.canonical());
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(int32_t i=0;i<threads;i++){
+		workers.emplace_back(worker);
+	}
+
+	batch_t batch;
+	int64_t batch_length=0;
+	while(kseq_read(seq) >= 0){
+		const int64_t len=seq->seq.l;
+		for(int64_t start=0;start+k<=len;start+=load_chunk_length){
+			const int64_t end=std::min(len, start+load_chunk_length+k-1);
+			batch.emplace_back(seq->seq.s+start, end-start);
+			batch_length+=end-start;
+			if(batch_length>=load_batch_length){
+				queue.push(std::move(batch));
+				batch=batch_t();
+				batch_length=0;
+			}
+		}
+	}
+	if(!batch.empty()){
+		queue.push(std::move(batch));
+	}
+	queue.close();
+
+	for(std::thread &t : workers){
+		t.join();
+	}
+
+	return 0;
+}
+
+
+/*
+	K-mers of the lines [begin, end) of an uncompressed FASTA file, scanned in
+	place (begin must be a line start). Header lines start new sequences,
+	other lines continue the current one. The lines [prime, begin) only fill
+	the k-mer window (a record continuing from before begin).
+*/
+template<typename _nkmer_T, typename _func_T>
+void kmers_from_fasta_lines(const char *prime, const char *begin, const char *end, int32_t k, _func_T f){
+	kmer_iterator_t<_nkmer_T> it(nullptr, 0, k);
+
+	auto scan=[&](const char *from, const char *to, bool emit){
+		const char *p=from;
+		while(p<to){
+			const char *eol=find_newline(p, to);
+			if(*p=='>'){
+				it.reset();
+			}
+			else{
+				const char *line_end=eol;
+				if(line_end>p && *(line_end-1)=='\r'){
+					line_end--;
+				}
+				it.resume(p, line_end-p);
+				while(it.next()){
+					if(emit){
+						f(it.canonical());
+					}
+				}
+			}
+			p=eol+1;
+		}
+	};
+
+	scan(prime, begin, false);
+	scan(begin, end, true);
+}
+
+/*
+	Start of the lines preceding begin that contain the last k-1 nucleotides
+	of the record continuing at begin.
+*/
+static inline const char *fasta_prime_start(const char *file_begin, const char *begin, int32_t k){
+	const char *p=begin;
+	int64_t needed=k-1;
+	while(needed>0 && p>file_begin){
+		const char *line_start=find_line_start(file_begin, p-1);
+		if(*line_start=='>'){
+			break;
+		}
+		const char *line_end=p-1;
+		if(line_end>line_start && *(line_end-1)=='\r'){
+			line_end--;
+		}
+		needed-=line_end-line_start;
+		p=line_start;
+	}
+	return p;
+}
+
+/*
+	Loading of an uncompressed FASTA file mapped into memory. The file is cut
+	into ranges of whole lines which are scanned by the workers.
+*/
+template<typename _set_T>
+int kmers_from_mapped_fasta(const mapped_file_t &file, _set_T &set, int32_t k, int32_t threads){
+	typedef typename _set_T::value_type nkmer_T;
+
+	if(threads<=1){
+		kmers_from_fasta_lines<nkmer_T>(file.begin(), file.begin(), file.end(), k,
+			[&](const nkmer_T &nkmer){ set.insert(nkmer); }
+		);
+		return 0;
+	}
+
+	std::vector<const char *> starts;
+	for(const char *p=file.begin();p<file.end();){
+		starts.push_back(p);
+		const char *q=p+std::min<int64_t>(load_batch_length, file.end()-p);
+		p=std::min(file.end(), find_newline(q, file.end())+1);
+	}
+	starts.push_back(file.end());
+
+	concurrent_inserter_t<_set_T> inserter(set);
+	std::atomic<size_t> next_range(0);
+
+	auto worker=[&](){
+		typename concurrent_inserter_t<_set_T>::buffers_t buffers(inserter);
+		size_t i;
+		while((i=next_range++)+1<starts.size()){
+			const char *prime=fasta_prime_start(file.begin(), starts[i], k);
+			kmers_from_fasta_lines<nkmer_T>(prime, starts[i], starts[i+1], k,
+				[&](const nkmer_T &nkmer){ buffers.insert(nkmer); }
+			);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(int32_t i=0;i<threads;i++){
+		workers.emplace_back(worker);
+	}
+	for(std::thread &t : workers){
+		t.join();
+	}
+
+	return 0;
+}
+
+/*
+	Error codes of the loaders.
+*/
+enum{
+	LOAD_OK=0,
+	LOAD_CANNOT_OPEN=-1,
+	LOAD_CORRUPTED=-2,
+	LOAD_NOT_KMER_SET=-3,
+	LOAD_WRONG_K=-4,
+	LOAD_TRUNCATED=-5,
+	LOAD_CORRUPTED_SET=-6,
+};
+
+static inline std::string load_error_message(int32_t error_code, const std::string &fn, int32_t k){
+	switch(error_code){
+		case LOAD_OK:
+			return "no error";
+		case LOAD_CANNOT_OPEN:
+			return "file '"+fn+"' could not be open";
+		case LOAD_CORRUPTED:
+			return "file '"+fn+"' could not be decompressed (corrupted or truncated)";
+		case LOAD_NOT_KMER_SET:
+			return "file '"+fn+"' is not a valid binary k-mer set";
+		case LOAD_WRONG_K:
+			return "binary k-mer set '"+fn+"' was created with another k (current k="+std::to_string(k)+")";
+		case LOAD_TRUNCATED:
+			return "binary k-mer set '"+fn+"' is truncated";
+		case LOAD_CORRUPTED_SET:
+			return "binary k-mer set '"+fn+"' is corrupted";
+		default:
+			return "file '"+fn+"' could not be loaded";
+	}
+}
+
+/*
+	Open a binary k-mer set (see kmer_dump.h) created with the same k.
+*/
+template<typename _nkmer_T>
+int32_t open_kmer_dump(const std::string &fn, kmer_dump_t<_nkmer_T> &dump, int32_t k){
+	const int32_t error_code=dump.open(fn);
+	if(error_code==KMER_DUMP_CANNOT_OPEN){
+		return LOAD_CANNOT_OPEN;
+	}
+	if((error_code==KMER_DUMP_OK || error_code==KMER_DUMP_WRONG_WIDTH) && static_cast<int32_t>(dump.header.k)!=k){
+		return LOAD_WRONG_K;
+	}
+	if(error_code==KMER_DUMP_CORRUPTED){
+		return LOAD_CORRUPTED_SET;
+	}
+	if(error_code!=KMER_DUMP_OK){
+		return LOAD_NOT_KMER_SET;
+	}
+	return LOAD_OK;
+}
+
+/* Error of reading the k-mers of an open binary k-mer set. */
+static inline int32_t kmer_dump_load_error(int32_t error_code){
+	switch(error_code){
+		case KMER_DUMP_OK:
+			return LOAD_OK;
+		case KMER_DUMP_CORRUPTED:
+			return LOAD_CORRUPTED_SET;
+		default:
+			return LOAD_TRUNCATED;
+	}
+}
+
+template<typename _set_T>
+int32_t kmers_from_dump(const std::string &fn, _set_T &set, int32_t k){
+	kmer_dump_t<typename _set_T::value_type> dump;
+	const int32_t error_code=open_kmer_dump(fn, dump, k);
+	if(error_code!=LOAD_OK){
+		return error_code;
+	}
+	set.reserve(dump.size());
+	return kmer_dump_load_error(
+		dump.for_each([&](const typename _set_T::value_type &nkmer){ set.insert(nkmer); })
+	);
+}
+
+template<typename _nkmer_T>
+int32_t kmers_from_dump(const std::string &fn, sorted_kmer_set_t<_nkmer_T> &set, int32_t k){
+	kmer_dump_t<_nkmer_T> dump;
+	const int32_t error_code=open_kmer_dump(fn, dump, k);
+	if(error_code!=LOAD_OK){
+		return error_code;
+	}
+	return kmer_dump_load_error(dump.copy_to(set.kmers));
+}
+
+/*
+	TODO: test if kmer is correct
+*/
+
+/*
+	Load the k-mers of a FASTA/FASTQ file (possibly compressed) or of a binary
+	k-mer set. Return a LOAD_* error code.
+*/
+//template<typename _nkmer_T, typename _set_T>
+template<typename _set_T>
+int32_t kmers_from_fasta(const std::string &fasta_fn, _set_T &set, int32_t k, int32_t threads, FILE* fstats,bool verbose){
+
+	if (verbose){
+		std::cerr << "Loading " + fasta_fn + "\n" << std::flush;
+	}
+
+	set.clear();
+
+	if(is_kmer_dump(fasta_fn)){
+		const int32_t error_code=kmers_from_dump(fasta_fn, set, k);
+		if(error_code==LOAD_OK && fstats){
+			fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+		}
+		return error_code;
+	}
+
+	/*
+		Uncompressed FASTA files are scanned in place; compressed files,
+		FASTQ and stdin go through kseq.
+	*/
+	mapped_file_t mapped;
+	if(fasta_fn!="-" && mapped.open(fasta_fn)==0 && (mapped.size()==0 || mapped.begin()[0]=='>')){
+		kmers_from_mapped_fasta(mapped, set, k, threads);
+		if(fstats){
+			fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+		}
+		return LOAD_OK;
+	}
+	mapped.close();
+
+	kseq_t *seq;
+	int64_t l;
+
+	FILE *instream = nullptr;
+	if(fasta_fn=="-"){
+		instream = stdin;
+	}
+	else {
+		instream = fopen(fasta_fn.c_str(), "r");
+		if(instream==nullptr){
+			return LOAD_CANNOT_OPEN;
+		}
+	}
+	/* decompression runs in separate threads */
+	std::unique_ptr<input_t> input(new input_t(instream, threads));
+	seq = kseq_init(input.get());
+
+	if(threads>1){
+		kmers_from_kseq_parallel(seq, set, k, threads);
+	}
+	else{
+		for(int32_t seqid=0;(l = kseq_read(seq)) >= 0;seqid++) {
+			kmer_iterator_t<typename _set_T::value_type> it(seq->seq.s, seq->seq.l, k);
+			while(it.next()){
+				set.insert(it.canonical());
+			}
+		}
+	}
+
+	const int32_t error_code=input->error() ? LOAD_CORRUPTED : LOAD_OK;
+
+	if(error_code==LOAD_OK && fstats){
+		fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+	}
+	//std::cerr << "iterator finished" << std::endl;
+
+	kseq_destroy(seq);
+	input.reset();
+	if(instream!=stdin){
+		fclose(instream);
+	}
+
+	return error_code;
+}
+
+/*
+	Sorted sets are collected without a hash table: the k-mers are sorted and
+	deduplicated in runs (sorted_kmer_collector_t).
+*/
+template<typename _nkmer_T>
+int32_t kmers_from_fasta(const std::string &fasta_fn, sorted_kmer_set_t<_nkmer_T> &set, int32_t k, int32_t threads, FILE* fstats,bool verbose){
+	if(is_kmer_dump(fasta_fn)){
+		if (verbose){
+			std::cerr << "Loading " + fasta_fn + "\n" << std::flush;
+		}
+		set.clear();
+		const int32_t error_code=kmers_from_dump(fasta_fn, set, k);
+		if(error_code==LOAD_OK && fstats){
+			fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+		}
+		return error_code;
+	}
+
+	sorted_kmer_collector_t<_nkmer_T> collector(k);
+	const int32_t error_code=kmers_from_fasta(fasta_fn, collector, k, threads, nullptr, verbose);
+	collector.move_to(set, threads);
+	if(error_code==LOAD_OK && fstats){
+		fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+	}
+	return error_code;
+}
+
+/*
+	Abundance filter (-m): the k-mers are counted first, then the solid ones
+	(occurring at least min_count times) are moved to the set partition by
+	partition.
+*/
+template<typename _nkmer_T>
+void solid_kmers(partitioned_kmer_counter_t<_nkmer_T> &counter, partitioned_kmer_set_t<_nkmer_T> &set, int32_t min_count, int32_t threads){
+	set.clear();
+	std::vector<typename partitioned_kmer_set_t<_nkmer_T>::partition_type *> partitions(set.no_partitions());
+	for(size_t p=0;p<partitions.size();p++){
+		partitions[p]=&set.partition(p);
+	}
+	run_tasks(partitions.size(), threads, [&](int32_t p){
+		counter.partition(p).for_each([&](const _nkmer_T &nkmer, uint8_t count){
+			if(count>=min_count){
+				partitions[p]->insert(nkmer);
+			}
+		});
+		counter.partition(p).clear();
+	});
+}
+
+/*
+	The same for a sorted set: the solid k-mers of every partition are
+	collected in parallel and radix-sorted (they are already distinct).
+*/
+template<typename _nkmer_T>
+void solid_kmers(partitioned_kmer_counter_t<_nkmer_T> &counter, sorted_kmer_set_t<_nkmer_T> &set, int32_t k, int32_t min_count, int32_t threads){
+	std::vector< std::vector<_nkmer_T> > parts(counter.no_partitions());
+	run_tasks(parts.size(), threads, [&](int32_t p){
+		counter.partition(p).for_each([&](const _nkmer_T &nkmer, uint8_t count){
+			if(count>=min_count){
+				parts[p].push_back(nkmer);
+			}
+		});
+		counter.partition(p).clear();
+	});
+
+	size_t n=0;
+	for(const std::vector<_nkmer_T> &part : parts){
+		n+=part.size();
+	}
+	set.clear();
+	set.kmers.reserve(n);
+	for(std::vector<_nkmer_T> &part : parts){
+		set.kmers.insert(set.kmers.end(), part.begin(), part.end());
+		std::vector<_nkmer_T>().swap(part);
+	}
+	radix_sort_kmers(set.kmers, k, threads);
+}
+
+template<typename _nkmer_T>
+int32_t solid_kmers_from_fasta(const std::string &fasta_fn, partitioned_kmer_set_t<_nkmer_T> &set, int32_t k, int32_t min_count, int32_t threads, bool verbose){
+	partitioned_kmer_counter_t<_nkmer_T> counter;
+	const int32_t error_code=kmers_from_fasta(fasta_fn, counter, k, threads, nullptr, verbose);
+	if(error_code!=LOAD_OK){
+		return error_code;
+	}
+	const size_t no_distinct=counter.size();
+
+	solid_kmers(counter, set, min_count, threads);
+
+	if(verbose){
+		std::cerr << "   solid k-mers: " << set.size() << " of " << no_distinct << std::endl;
+	}
+
+	return LOAD_OK;
+}
+
+template<typename _nkmer_T>
+int32_t solid_kmers_from_fasta(const std::string &fasta_fn, sorted_kmer_set_t<_nkmer_T> &set, int32_t k, int32_t min_count, int32_t threads, bool verbose){
+	partitioned_kmer_counter_t<_nkmer_T> counter;
+	const int32_t error_code=kmers_from_fasta(fasta_fn, counter, k, threads, nullptr, verbose);
+	if(error_code!=LOAD_OK){
+		return error_code;
+	}
+	const size_t no_distinct=counter.size();
+
+	solid_kmers(counter, set, k, min_count, threads);
+
+	if(verbose){
+		std::cerr << "   solid k-mers: " << set.size() << " of " << no_distinct << std::endl;
+	}
+
+	return LOAD_OK;
+}
+
+/*
+	Load an input (FASTA or binary k-mer set); binary sets are not filtered.
+*/
+template<typename _set_T>
+int32_t load_kmers(const std::string &fn, _set_T &set, int32_t k, int32_t min_count, int32_t threads, bool verbose){
+	if(min_count>1 && !is_kmer_dump(fn)){
+		return solid_kmers_from_fasta(fn, set, k, min_count, threads, verbose);
+	}
+	return kmers_from_fasta(fn, set, k, threads, nullptr, verbose);
+}
+
+template<typename _set_T>
+int32_t find_intersection(const std::vector<const _set_T *> &sets, _set_T &intersection, int32_t threads){
+	assert(sets.size()>0);
+
+	/*
+		1) Find the smallest set from sets.
+	*/
+
+	int64_t min=std::numeric_limits<int64_t>::max();
+	int32_t i_min=-1;
+
+	for(int32_t i=0;i<static_cast<int32_t>(sets.size());i++){
+		if (static_cast<int64_t>(sets[i]->size())<min){
+			min=sets[i]->size();
+			i_min=i;
+		}
+	}
+
+	assert(i_min!=-1);
+
+	/*
+		2) Keep the elements of the smallest set present in all other sets
+		   (partitions are processed in parallel).
+	*/
+
+	intersection.clear();
+	intersection.reserve(sets[i_min]->size());
+
+	const size_t no_partitions=intersection.no_partitions();
+	std::vector<typename _set_T::partition_type *> partitions(no_partitions);
+	for(size_t p=0;p<no_partitions;p++){
+		partitions[p]=&intersection.partition(p);
+	}
+
+	const _set_T &smallest=*sets[i_min];
+	run_tasks(no_partitions, threads, [&](int32_t p){
+		for(const auto &nkmer : smallest.partition(p)){
+			bool in_all=true;
+			for(const _set_T *current_set : sets) {
+				if(current_set->count(nkmer)==0){
+					in_all=false;
+					break;
+				}
+			}
+			if(in_all){
+				partitions[p]->insert(nkmer);
+			}
+		}
+	});
+
+	return 0;
+}
+
+template<typename _set_T>
+int32_t find_intersection(const std::vector<_set_T> &sets, _set_T &intersection, int32_t threads){
+	std::vector<const _set_T *> set_ptrs;
+	for(const _set_T &set : sets){
+		set_ptrs.push_back(&set);
+	}
+	return find_intersection(set_ptrs, intersection, threads);
+}
+
+template<typename _nkmer_T>
+int32_t find_intersection(const std::vector< sorted_kmer_set_t<_nkmer_T> > &sets, sorted_kmer_set_t<_nkmer_T> &intersection, int32_t threads){
+	return sorted_intersection(sets, intersection, threads);
+}
+
+
+/*
+	Remove a subset from all sets. The partitions are processed in parallel
+	(all sets have the same partitioning) and the subset is scanned by slots,
+	so that the workers share no iterator state.
+*/
+template<typename _set_T>
+int32_t remove_subset(std::vector<_set_T> &sets, const _set_T &subset, int32_t threads){
+	typedef typename _set_T::value_type nkmer_T;
+	typedef typename _set_T::partition_type partition_T;
+
+	const size_t no_partitions=subset.no_partitions();
+	std::vector< std::vector<partition_T *> > partitions(sets.size(), std::vector<partition_T *>(no_partitions));
+	for(size_t p=0;p<no_partitions;p++){
+		for(size_t i=0;i<sets.size();i++){
+			partitions[i][p]=&sets[i].partition(p);
+		}
+	}
+
+	run_tasks(no_partitions, threads, [&](int32_t p){
+		const partition_T &subset_partition=subset.partition(p);
+		for(size_t slot=0;slot<subset_partition.capacity();slot++){
+			if(!subset_partition.occupied(slot)){
+				continue;
+			}
+			const nkmer_T &nkmer=subset_partition.at(slot);
+			const uint64_t hash=kmer_hash(nkmer);
+			for(size_t i=0;i<sets.size();i++){
+				partitions[i][p]->erase(nkmer, hash);
+			}
+		}
+	});
+
+	return 0;
+}
+
+template<typename _nkmer_T>
+int32_t remove_subset(std::vector< sorted_kmer_set_t<_nkmer_T> > &sets, const sorted_kmer_set_t<_nkmer_T> &subset, int32_t threads){
+	return sorted_remove_subset(sets, subset, threads);
+}
+
+/*
+	Fused intersection and subtraction: the k-mers present in all sets are
+	moved into intersection and removed from all sets, in one pass over the
+	smallest set. The sets are processed by partitions in parallel; all sets
+	have the same partitioning, so every k-mer is hashed only once.
+*/
+template<typename _set_T>
+int32_t extract_intersection(std::vector<_set_T> &sets, _set_T &intersection, int32_t threads){
+	typedef typename _set_T::value_type nkmer_T;
+	typedef typename _set_T::partition_type partition_T;
+	assert(sets.size()>0);
+
+	size_t i_min=0;
+	for(size_t i=1;i<sets.size();i++){
+		if(sets[i].size()<sets[i_min].size()){
+			i_min=i;
+		}
+	}
+
+	intersection.clear();
+
+	const size_t no_partitions=intersection.no_partitions();
+	std::vector< std::vector<partition_T *> > partitions(sets.size(), std::vector<partition_T *>(no_partitions));
+	std::vector<partition_T *> intersection_partitions(no_partitions);
+	for(size_t p=0;p<no_partitions;p++){
+		for(size_t i=0;i<sets.size();i++){
+			partitions[i][p]=&sets[i].partition(p);
+		}
+		intersection_partitions[p]=&intersection.partition(p);
+	}
+
+	run_tasks(no_partitions, threads, [&](int32_t p){
+		const partition_T &smallest=*partitions[i_min][p];
+		std::vector<nkmer_T> shared;
+		std::vector<uint64_t> hashes;
+		for(size_t slot=0;slot<smallest.capacity();slot++){
+			if(!smallest.occupied(slot)){
+				continue;
+			}
+			const nkmer_T &nkmer=smallest.at(slot);
+			const uint64_t hash=kmer_hash(nkmer);
+			bool in_all=true;
+			for(size_t i=0;i<sets.size();i++){
+				if(i!=i_min && partitions[i][p]->count(nkmer, hash)==0){
+					in_all=false;
+					break;
+				}
+			}
+			if(in_all){
+				shared.push_back(nkmer);
+				hashes.push_back(hash);
+			}
+		}
+
+		partition_T &intersection_partition=*intersection_partitions[p];
+		intersection_partition.reserve(shared.size());
+		for(size_t j=0;j<shared.size();j++){
+			intersection_partition.insert(shared[j]);
+			for(size_t i=0;i<sets.size();i++){
+				partitions[i][p]->erase(shared[j], hashes[j]);
+			}
+		}
+	});
+
+	return 0;
+}
+
+template<typename _nkmer_T>
+int32_t extract_intersection(std::vector< sorted_kmer_set_t<_nkmer_T> > &sets, sorted_kmer_set_t<_nkmer_T> &intersection, int32_t threads){
+	return sorted_extract_intersection(sets, intersection, threads);
+}
+
+
+/*
+	Greedily extend a contig, initialized by the central k-mer, first to the
+	right and then to the left. take(nkmer) must return true iff the
+	canonical k-mer nkmer is available, and make it unavailable.
+
+	The forward and reverse-complement words of the last k-mer are kept, so
+	the four candidate successors are obtained by a shift and a mask; the
+	left extension is the right extension of the reverse complement.
+*/
+template<typename _nkmer_T, typename _take_T>
+void extend_contig(contig_t &contig, const _nkmer_T &central_nkmer, int32_t k, _take_T take){
+	const _nkmer_T mask=kmer_mask<_nkmer_T>(k);
+	_nkmer_T high_complement[4];
+	for(int32_t nt4=0;nt4<4;nt4++){
+		high_complement[nt4]=_nkmer_T(3-nt4) << (2*(k-1));
+	}
+
+	const _nkmer_T central_nkmer_rc=reverse_complement_kmer(central_nkmer, k);
+
+	for (int direction=0;direction<2;direction++){
+
+		_nkmer_T nkmer_f;
+		_nkmer_T nkmer_r;
+
+		if (direction==0){
+			// forward
+			nkmer_f=central_nkmer;
+			nkmer_r=central_nkmer_rc;
+		}
+		else{
+			// reverse
+			nkmer_f=central_nkmer_rc;
+			nkmer_r=central_nkmer;
+		}
+
+		bool extending = true;
+
+		while (extending){
+			const _nkmer_T prefix_f=(nkmer_f << 2) & mask;
+			const _nkmer_T suffix_r=nkmer_r >> 2;
+
+			extending=false;
+			for(int32_t nt4=0;nt4<4;nt4++){
+				const _nkmer_T next_f=prefix_f | _nkmer_T(nt4);
+				const _nkmer_T next_r=suffix_r | high_complement[nt4];
+
+				if(take(std::min(next_f,next_r))){
+					if(direction==0){
+						contig.r_extend(nt4_nt256[nt4]);
+					}
+					else{
+						contig.l_extend(nt4_nt256[nt4]);
+					}
+					nkmer_f=next_f;
+					nkmer_r=next_r;
+					extending=true;
+					break;
+				}
+			}
+		}
+	}
+}
+
+/*
+	Greedy assembly of simplitigs: take any k-mer, extend it in both
+	directions, repeat until the set is empty. Every simplitig is passed to
+	output(seq, len). Return the number of simplitigs.
+*/
+template<typename _set_T, typename _output_T>
+int64_t assemble_simplitigs(_set_T &set, int32_t k, _output_T output){
+	typedef typename _set_T::value_type nkmer_T;
+
+	contig_t contig(k);
+
+	int64_t no_contigs=0;
+	while(set.size()>0){
+
+		const auto central_nkmer=*(set.begin());
+		set.erase(central_nkmer);
+
+		std::string central_kmer_string;
+		decode_kmer(central_nkmer,k,central_kmer_string);
+		contig.new_contig(central_kmer_string.c_str());
+
+		extend_contig(contig, central_nkmer, k,
+			[&](const nkmer_T &nkmer){ return set.erase(nkmer)>0; }
+		);
+
+		output(contig.data(), contig.size());
+		no_contigs++;
+	}
+
+	return no_contigs;
+}
+
+}
+}
+
+#endif
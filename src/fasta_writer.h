@@ -0,0 +1,157 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Buffered FASTA writer. Records are formatted by memcpy into a large
+	user-space buffer, which is passed to the output stream when full. The
+	sequence lengths of the records are kept for statistics.
+*/
+
+#ifndef FASTA_WRITER_H
+#define FASTA_WRITER_H
+
+#include "output.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
+
+class fasta_writer_t{
+public:
+	/*
+		line_length: length of sequence lines (0 = one line per sequence)
+	*/
+	fasta_writer_t(output_t &_out, int32_t _line_length, size_t buffer_size=1<<22):
+		out(_out), line_length(_line_length), buffer(buffer_size), used(0), column(0)
+	{
+	}
+
+	~fasta_writer_t(){
+		flush();
+	}
+
+	/* Write a record with the name <prefix><id>. */
+	void write_record(const char *prefix, uint64_t id, const char *seq, int64_t len){
+		begin_record(prefix, id);
+		append_sequence(seq, len);
+		end_record();
+	}
+
+	/*
+		Write a record in parts: begin_record(), any number of
+		append_sequence() and end_record().
+	*/
+	void begin_record(const char *prefix, uint64_t id){
+		char name[32];
+		char *p=name+sizeof(name);
+		do{
+			*--p='0'+id%10;
+			id/=10;
+		} while(id>0);
+
+		put('>');
+		put(prefix, strlen(prefix));
+		put(p, name+sizeof(name)-p);
+		put('\n');
+		column=0;
+		lengths.push_back(0);
+	}
+
+	void append_sequence(const char *seq, int64_t len){
+		lengths.back()+=len;
+		if(line_length<=0){
+			put(seq, len);
+			return;
+		}
+		while(len>0){
+			const int64_t n=std::min<int64_t>(len, line_length-column);
+			put(seq, n);
+			seq+=n;
+			len-=n;
+			column+=n;
+			if(column==line_length){
+				put('\n');
+				column=0;
+			}
+		}
+	}
+
+	void end_record(){
+		if(line_length<=0 || column>0){
+			put('\n');
+		}
+		column=0;
+	}
+
+	/* Sequence lengths of the records written so far. */
+	const std::vector<uint64_t> &record_lengths() const {
+		return lengths;
+	}
+
+	void flush(){
+		if(used>0){
+			out.write(buffer.data(), used);
+			used=0;
+		}
+	}
+
+private:
+	output_t &out;
+	int32_t line_length;
+	std::vector<char> buffer;
+	size_t used;
+
+	/* position in the current sequence line */
+	int64_t column;
+
+	std::vector<uint64_t> lengths;
+
+	void put(char c){
+		if(used==buffer.size()){
+			flush();
+		}
+		buffer[used++]=c;
+	}
+
+	void put(const char *s, size_t n){
+		if(used+n>buffer.size()){
+			flush();
+			if(n>buffer.size()){
+				out.write(s, n);
+				return;
+			}
+		}
+		memcpy(buffer.data()+used, s, n);
+		used+=n;
+	}
+};
+
+#endif
@@ -0,0 +1,410 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Input stream of the FASTA parser with decompression in a separate
+	pipeline stage.
+
+	Gzipped (or plain) data are decompressed by a dedicated thread into
+	buffers handed over to the reader (double buffering), so that inflate
+	runs concurrently with parsing and k-mer insertion. BGZF files (blocked
+	gzip, e.g., from bgzip or prophasm -z) are additionally decompressed
+	block-parallel by a pool of threads.
+*/
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "parallel.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class input_t{
+public:
+	/* size of the buffers handed over to the reader */
+	static const size_t buffer_size=1<<20;
+
+	/* number of BGZF blocks decompressed as a single job */
+	static const size_t bgzf_blocks_per_job=64;
+
+	/*
+		threads: number of threads inflating BGZF blocks (other data are
+		decompressed by a single thread)
+	*/
+	input_t(FILE *_file, int32_t _threads):
+		file(_file), threads(std::max(1, _threads)), failed(false),
+		buffers(2), jobs(2*std::max(1, _threads)), pending(2*std::max(1, _threads)),
+		pos(0)
+	{
+		head.resize(18);
+		head.resize(fread(head.data(), 1, head.size(), file));
+
+		bgzf=is_bgzf(head) && threads>1;
+		if(bgzf){
+			for(int32_t i=0;i<threads;i++){
+				inflaters.emplace_back(&input_t::inflate_jobs, this);
+			}
+		}
+		decoder=std::thread(&input_t::decode, this);
+	}
+
+	~input_t(){
+		/* let the decoding stage run to the end if the reader stopped early */
+		std::vector<char> buffer;
+		while(next_buffer(buffer)){
+		}
+		decoder.join();
+		for(std::thread &t : inflaters){
+			t.join();
+		}
+	}
+
+	input_t(const input_t &)=delete;
+	input_t &operator=(const input_t &)=delete;
+
+	/* Read up to len bytes; return 0 at the end of the data (or on error). */
+	int read(void *buf, unsigned len){
+		while(pos==current.size()){
+			pos=0;
+			if(!next_buffer(current)){
+				current.clear();
+				return 0;
+			}
+		}
+		const size_t n=std::min<size_t>(len, current.size()-pos);
+		memcpy(buf, current.data()+pos, n);
+		pos+=n;
+		return n;
+	}
+
+	/* True if the data could not be decompressed. */
+	bool error() const {
+		return failed;
+	}
+
+private:
+	/* a batch of BGZF blocks */
+	struct job_t{
+		std::vector<char> compressed;
+		std::vector<char> data;
+		bool done=false;
+		std::mutex mutex;
+		std::condition_variable ready;
+	};
+
+	FILE *file;
+	int32_t threads;
+	std::atomic<bool> failed;
+
+	/* decompressed data of the non-BGZF path */
+	bounded_queue_t< std::vector<char> > buffers;
+
+	/* BGZF jobs, to the inflaters and (in order) to the reader */
+	bounded_queue_t< std::shared_ptr<job_t> > jobs;
+	bounded_queue_t< std::shared_ptr<job_t> > pending;
+	bool bgzf;
+
+	std::thread decoder;
+	std::vector<std::thread> inflaters;
+
+	std::vector<char> current;
+	size_t pos;
+
+	/* data read ahead by the format detection */
+	std::vector<char> head;
+	size_t head_pos=0;
+
+	size_t read_raw(char *buf, size_t len){
+		size_t n=0;
+		if(head_pos<head.size()){
+			n=std::min(len, head.size()-head_pos);
+			memcpy(buf, head.data()+head_pos, n);
+			head_pos+=n;
+		}
+		if(n<len){
+			n+=fread(buf+n, 1, len-n, file);
+		}
+		return n;
+	}
+
+	bool next_buffer(std::vector<char> &buffer){
+		if(!bgzf){
+			return buffers.pop(buffer);
+		}
+		std::shared_ptr<job_t> job;
+		if(!pending.pop(job)){
+			return false;
+		}
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->ready.wait(lock, [&]{ return job->done; });
+		buffer.swap(job->data);
+		return true;
+	}
+
+	/*
+		Header of a BGZF block (18 bytes): gzip magic, deflate, FEXTRA with
+		a single 'BC' subfield (XLEN=6, SLEN=2) holding BSIZE.
+	*/
+	static bool is_bgzf_header(const char *h){
+		return static_cast<uint8_t>(h[0])==0x1f && static_cast<uint8_t>(h[1])==0x8b
+			&& h[2]==8 && (h[3] & 4)!=0
+			&& h[10]==6 && h[11]==0
+			&& h[12]=='B' && h[13]=='C'
+			&& h[14]==2 && h[15]==0;
+	}
+
+	/* Size of a BGZF block (BSIZE+1) from its header. */
+	static size_t bgzf_block_size(const char *h){
+		return (static_cast<uint8_t>(h[16]) | (static_cast<uint8_t>(h[17]) << 8))+1;
+	}
+
+	/* header, at least an empty deflate block, CRC32 and ISIZE */
+	static const size_t bgzf_min_block_size=26;
+
+	/* maximum size of the uncompressed data of a BGZF block */
+	static const uint32_t bgzf_max_isize=1<<16;
+
+	static bool is_bgzf(const std::vector<char> &h){
+		return h.size()>=18 && is_bgzf_header(h.data());
+	}
+
+	/* decoding stage */
+	void decode(){
+		if(bgzf){
+			split_bgzf();
+			jobs.close();
+			pending.close();
+		}
+		else{
+			inflate_stream();
+			buffers.close();
+		}
+	}
+
+	/* Cut the BGZF stream into batches of blocks. */
+	void split_bgzf(){
+		std::shared_ptr<job_t> job(new job_t());
+		size_t no_blocks=0;
+		char header[18];
+		while(true){
+			const size_t n=read_raw(header, 18);
+			if(n==0){
+				break;
+			}
+			if(n<18 || !is_bgzf_header(header)){
+				failed=true;
+				break;
+			}
+			const size_t block_size=bgzf_block_size(header);
+			if(block_size<bgzf_min_block_size){
+				failed=true;
+				break;
+			}
+			const size_t offset=job->compressed.size();
+			job->compressed.resize(offset+block_size);
+			memcpy(job->compressed.data()+offset, header, 18);
+			if(read_raw(job->compressed.data()+offset+18, block_size-18)!=block_size-18){
+				failed=true;
+				break;
+			}
+			if(++no_blocks==bgzf_blocks_per_job){
+				submit(job);
+				job.reset(new job_t());
+				no_blocks=0;
+			}
+		}
+		if(no_blocks>0){
+			submit(job);
+		}
+	}
+
+	void submit(const std::shared_ptr<job_t> &job){
+		pending.push(job);
+		jobs.push(job);
+	}
+
+	void inflate_jobs(){
+		std::shared_ptr<job_t> job;
+		while(jobs.pop(job)){
+			std::vector<char> data;
+			if(!inflate_blocks(job->compressed, data)){
+				failed=true;
+			}
+			{
+				std::lock_guard<std::mutex> lock(job->mutex);
+				job->data.swap(data);
+				job->done=true;
+			}
+			job->ready.notify_all();
+		}
+	}
+
+	/* Little-endian 32-bit integer of the gzip trailer. */
+	static uint32_t read_uint32(const uint8_t *b){
+		return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+	}
+
+	/* Decompress a sequence of BGZF blocks. */
+	static bool inflate_blocks(const std::vector<char> &compressed, std::vector<char> &data){
+		size_t p=0;
+		while(p<compressed.size()){
+			const uint8_t *block=reinterpret_cast<const uint8_t *>(compressed.data()+p);
+			if(compressed.size()-p<bgzf_min_block_size){
+				return false;
+			}
+			const size_t block_size=bgzf_block_size(compressed.data()+p);
+			if(block_size<bgzf_min_block_size || block_size>compressed.size()-p){
+				return false;
+			}
+			const uint32_t crc=read_uint32(block+block_size-8);
+			const uint32_t isize=read_uint32(block+block_size-4);
+			if(isize>bgzf_max_isize){
+				return false;
+			}
+			const size_t offset=data.size();
+			data.resize(offset+isize);
+
+			z_stream zs;
+			memset(&zs, 0, sizeof(zs));
+			if(inflateInit2(&zs, -15)!=Z_OK){
+				return false;
+			}
+			zs.next_in=const_cast<Bytef *>(block+18);
+			zs.avail_in=block_size-18-8;
+			zs.next_out=reinterpret_cast<Bytef *>(data.data()+offset);
+			zs.avail_out=isize;
+			const int ret=inflate(&zs, Z_FINISH);
+			inflateEnd(&zs);
+			if(ret!=Z_STREAM_END || zs.total_out!=isize){
+				return false;
+			}
+			/* raw inflate does not check the trailer */
+			if(crc32(0L, reinterpret_cast<const Bytef *>(data.data()+offset), isize)!=crc){
+				return false;
+			}
+			p+=block_size;
+		}
+		return true;
+	}
+
+	/*
+		Decompress a gzip stream (possibly of several members), or pass
+		uncompressed data through.
+	*/
+	void inflate_stream(){
+		std::vector<char> in(buffer_size);
+		const bool gzip=head.size()>=2 && static_cast<uint8_t>(head[0])==0x1f && static_cast<uint8_t>(head[1])==0x8b;
+
+		if(!gzip){
+			while(true){
+				in.resize(buffer_size);
+				in.resize(read_raw(in.data(), in.size()));
+				if(in.empty()){
+					break;
+				}
+				buffers.push(std::move(in));
+				in=std::vector<char>();
+			}
+			return;
+		}
+
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		if(inflateInit2(&zs, 15+16)!=Z_OK){
+			failed=true;
+			return;
+		}
+		std::vector<char> out(buffer_size);
+		size_t out_used=0;
+		bool end_of_input=false;
+		/* at the end of a member (anything but another member is ignored, as by gzread) */
+		bool member_end=false;
+		while(true){
+			if(zs.avail_in==0 && !end_of_input){
+				const size_t n=read_raw(in.data(), in.size());
+				end_of_input=(n==0);
+				zs.next_in=reinterpret_cast<Bytef *>(in.data());
+				zs.avail_in=n;
+			}
+			if(zs.avail_in==0 && end_of_input){
+				failed=failed || !member_end;
+				break;
+			}
+			zs.next_out=reinterpret_cast<Bytef *>(out.data()+out_used);
+			zs.avail_out=out.size()-out_used;
+			const int ret=inflate(&zs, Z_NO_FLUSH);
+			const bool produced=(out.size()-zs.avail_out)>out_used;
+			out_used=out.size()-zs.avail_out;
+			if(ret==Z_STREAM_END){
+				/* next member of a multi-member file */
+				inflateReset(&zs);
+				member_end=true;
+			}
+			else if(ret==Z_DATA_ERROR && member_end && !produced){
+				/* trailing garbage */
+				break;
+			}
+			else if(ret!=Z_OK && !(ret==Z_BUF_ERROR && zs.avail_in==0)){
+				failed=true;
+				break;
+			}
+			else if(produced){
+				member_end=false;
+			}
+			if(out_used==out.size()){
+				buffers.push(std::move(out));
+				out=std::vector<char>(buffer_size);
+				out_used=0;
+			}
+		}
+		inflateEnd(&zs);
+		if(out_used>0){
+			out.resize(out_used);
+			buffers.push(std::move(out));
+		}
+	}
+};
+
+inline int input_read(input_t *in, void *buf, unsigned len){
+	return in->read(buf, len);
+}
+
+#endif
@@ -0,0 +1,227 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Minimizer-based bucketing of k-mers to disk for the external memory
+	mode.
+
+	Every canonical k-mer is assigned to one of no_buckets buckets by the
+	hash of its minimizer (the canonical m-mer with the smallest hash); the
+	minimizer is strand independent and is shared by most consecutive
+	k-mers of a sequence, so simplitigs mostly stay within one bucket.
+
+	kmer_bucket_writer_t has the interface of a partitioned set (the buckets
+	are its partitions), so that all loaders can fill it directly. The
+	k-mers are appended to one file per bucket as raw k-mer words.
+*/
+
+#ifndef KMER_BUCKETS_H
+#define KMER_BUCKETS_H
+
+#include "kmer_set.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+/*
+	Reverse complement of a 2-bit encoded m-mer (m <= 32).
+*/
+inline uint64_t reverse_complement_mmer(uint64_t x, int32_t m){
+	x=((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+	x=((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+	x=__builtin_bswap64(x);
+	return (~x) >> (64-2*m);
+}
+
+/*
+	Hash of the minimizer of a k-mer (minimum over the hashes of all its
+	canonical m-mers, m <= min(k, 32)).
+*/
+template<typename _nkmer_T>
+uint64_t kmer_minimizer(_nkmer_T nkmer, int32_t k, int32_t m){
+	assert(0<m && m<=k && m<=32);
+	const uint64_t mmer_mask=(m==32) ? ~0ULL : ((1ULL << (2*m))-1);
+	uint64_t minimizer=~0ULL;
+	for(int32_t i=0;i+m<=k;i++){
+		const uint64_t mmer=static_cast<uint64_t>(nkmer & _nkmer_T(mmer_mask));
+		minimizer=std::min(minimizer, kmer_hash(std::min(mmer, reverse_complement_mmer(mmer, m))));
+		nkmer>>=2;
+	}
+	return minimizer;
+}
+
+
+inline int32_t default_minimizer_length(int32_t k){
+	return std::min(k, 15);
+}
+
+
+template<typename _nkmer_T>
+class kmer_bucket_writer_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+
+	/* k-mers buffered per bucket */
+	static const size_t buffer_length=1<<13;
+
+	class bucket_t{
+	public:
+		bucket_t(): file(nullptr), deduplicate(false), written(0), failed(false) {}
+
+		/* Append a k-mer; return true (the bucket does not check duplicates). */
+		bool insert(const _nkmer_T &nkmer){
+			buffer.push_back(nkmer);
+			if(buffer.size()>=buffer_length){
+				flush();
+			}
+			return true;
+		}
+
+		void flush(){
+			if(deduplicate){
+				std::sort(buffer.begin(), buffer.end());
+				buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+			}
+			if(file==nullptr || fwrite(buffer.data(), sizeof(_nkmer_T), buffer.size(), file)!=buffer.size()){
+				failed=true;
+			}
+			written+=buffer.size();
+			buffer.clear();
+		}
+
+	private:
+		friend class kmer_bucket_writer_t;
+		FILE *file;
+		bool deduplicate;
+		std::vector<_nkmer_T> buffer;
+		size_t written;
+		bool failed;
+	};
+
+	typedef bucket_t partition_type;
+
+	/*
+		fns: file of every bucket
+		deduplicate: remove duplicates within the buffers (k-mers are
+			not counted)
+	*/
+	kmer_bucket_writer_t(const std::vector<std::string> &fns, int32_t _k, int32_t _m, bool deduplicate):
+		buckets(fns.size()), k(_k), m(_m)
+	{
+		assert((fns.size() & (fns.size()-1))==0);
+		for(size_t b=0;b<buckets.size();b++){
+			buckets[b].file=fopen(fns[b].c_str(), "wb");
+			buckets[b].failed=(buckets[b].file==nullptr);
+			buckets[b].deduplicate=deduplicate;
+			buckets[b].buffer.reserve(buffer_length);
+		}
+	}
+
+	~kmer_bucket_writer_t(){
+		close();
+	}
+
+	kmer_bucket_writer_t(const kmer_bucket_writer_t &)=delete;
+	kmer_bucket_writer_t &operator=(const kmer_bucket_writer_t &)=delete;
+
+	size_t no_partitions() const { return buckets.size(); }
+	bucket_t &partition(size_t b){ return buckets[b]; }
+
+	size_t partition_of(const _nkmer_T &nkmer) const {
+		return static_cast<size_t>(kmer_minimizer(nkmer, k, m)) & (buckets.size()-1);
+	}
+
+	bool insert(const _nkmer_T &nkmer){
+		return buckets[partition_of(nkmer)].insert(nkmer);
+	}
+
+	/* Number of k-mers written (with duplicates). */
+	size_t size() const {
+		size_t s=0;
+		for(const bucket_t &bucket : buckets){
+			s+=bucket.written+bucket.buffer.size();
+		}
+		return s;
+	}
+
+	/* The files are only appended to; clear() and reserve() do nothing. */
+	void clear(){}
+	void reserve(size_t){}
+
+	/* Flush and close all files. Return false if any write failed. */
+	bool close(){
+		bool ok=true;
+		for(bucket_t &bucket : buckets){
+			if(bucket.file!=nullptr){
+				bucket.flush();
+				ok=(fclose(bucket.file)==0) && ok;
+				bucket.file=nullptr;
+			}
+			ok=ok && !bucket.failed;
+		}
+		return ok;
+	}
+
+private:
+	std::vector<bucket_t> buckets;
+	int32_t k;
+	int32_t m;
+};
+
+
+/*
+	Call f for all k-mers of a bucket file. Return false if the file cannot be
+	read.
+*/
+template<typename _nkmer_T, typename _func_T>
+bool read_kmer_bucket(const std::string &fn, _func_T f){
+	FILE *file=fopen(fn.c_str(), "rb");
+	if(file==nullptr){
+		return false;
+	}
+	std::vector<_nkmer_T> buffer(1<<16);
+	size_t n;
+	while((n=fread(buffer.data(), sizeof(_nkmer_T), buffer.size(), file))>0){
+		for(size_t i=0;i<n;i++){
+			f(buffer[i]);
+		}
+	}
+	const bool ok=!ferror(file);
+	fclose(file);
+	return ok;
+}
+
+#endif
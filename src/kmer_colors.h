@@ -0,0 +1,341 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Colored k-mer table: a single hash table of the k-mers of all inputs,
+	where every k-mer carries a bitmask (color) of the inputs containing it.
+	Shared k-mers are stored once, and the intersection, the differences
+	and any other region of the Venn diagram of the inputs are obtained by
+	scanning the table.
+
+	The colors are stored in a parallel byte array (ceil(no_colors/8) bytes
+	per slot). The table uses the same hashing and Robin Hood probing as
+	kmer_set_t (insertions only), and partitioned_kmer_color_table_t the
+	same partitioning as partitioned_kmer_set_t.
+*/
+
+#ifndef KMER_COLORS_H
+#define KMER_COLORS_H
+
+#include "kmer_set.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+
+template<typename _nkmer_T>
+class kmer_color_table_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+
+	kmer_color_table_t(int32_t _no_colors=1, double _max_load_factor=0.75):
+		no_colors(_no_colors),
+		stride((_no_colors+7)/8),
+		table(min_capacity, empty_key()),
+		colors(min_capacity*stride, 0),
+		carry(stride),
+		mask(min_capacity-1),
+		no_elements(0),
+		max_load(_max_load_factor),
+		color(0)
+	{
+		assert(no_colors>0);
+		assert(0.0 < max_load && max_load < 1.0);
+	}
+
+	size_t size() const { return no_elements; }
+	bool empty() const { return no_elements==0; }
+	size_t capacity() const { return table.size(); }
+
+	void clear(){
+		std::vector<_nkmer_T>(min_capacity, empty_key()).swap(table);
+		std::vector<uint8_t>(min_capacity*stride, 0).swap(colors);
+		mask=min_capacity-1;
+		no_elements=0;
+	}
+
+	void reserve(size_t n){
+		size_t new_capacity=min_capacity;
+		while(new_capacity*max_load < n+1){
+			new_capacity*=2;
+		}
+		if(new_capacity>table.size()){
+			rehash(new_capacity);
+		}
+	}
+
+	/* Color of the subsequently inserted k-mers. */
+	void set_color(int32_t c){
+		assert(0<=c && c<no_colors);
+		color=c;
+	}
+
+	/* Insert a k-mer with the current color. Return true if it was not present. */
+	bool insert(const _nkmer_T &nkmer){
+		assert(nkmer!=empty_key());
+		if((no_elements+1) > table.size()*max_load){
+			rehash(2*table.size());
+		}
+		std::fill(carry.begin(), carry.end(), 0);
+		carry[color/8]=1 << (color%8);
+		return add(nkmer);
+	}
+
+	bool occupied(size_t slot) const {
+		return table[slot]!=empty_key();
+	}
+
+	const _nkmer_T &at(size_t slot) const {
+		return table[slot];
+	}
+
+	bool has_color(size_t slot, int32_t c) const {
+		return (colors[slot*stride+c/8] >> (c%8)) & 1;
+	}
+
+	bool has_all_colors(size_t slot) const {
+		const uint8_t *c=&colors[slot*stride];
+		for(int32_t b=0;b<no_colors/8;b++){
+			if(c[b]!=0xff){
+				return false;
+			}
+		}
+		const uint8_t last=(1 << (no_colors%8))-1;
+		return (c[stride-1] & last)==last;
+	}
+
+	void add_probe_lengths(std::vector<uint64_t> &histogram) const {
+		for(size_t i=0;i<table.size();i++){
+			if(table[i]==empty_key()){
+				continue;
+			}
+			const size_t d=distance(i);
+			if(d>=histogram.size()){
+				histogram.resize(d+1, 0);
+			}
+			histogram[d]++;
+		}
+	}
+
+private:
+	static const size_t min_capacity=16;
+
+	int32_t no_colors;
+
+	/* bytes per color */
+	size_t stride;
+
+	std::vector<_nkmer_T> table;
+	std::vector<uint8_t> colors;
+
+	/* color of the element being inserted */
+	std::vector<uint8_t> carry;
+
+	size_t mask;
+	size_t no_elements;
+	double max_load;
+	int32_t color;
+
+	static const _nkmer_T &empty_key(){
+		return kmer_set_t<_nkmer_T>::empty_key;
+	}
+
+	size_t home_slot(const _nkmer_T &nkmer) const {
+		return static_cast<size_t>(kmer_hash(nkmer)) & mask;
+	}
+
+	size_t distance(size_t i) const {
+		return (i-home_slot(table[i])) & mask;
+	}
+
+	/* Insert nkmer with the color in carry (merged if present). */
+	bool add(const _nkmer_T &nkmer){
+		_nkmer_T x=nkmer;
+		size_t i=home_slot(x);
+		size_t d=0;
+		while(table[i]!=empty_key()){
+			uint8_t *c=&colors[i*stride];
+			if(table[i]==x){
+				for(size_t b=0;b<stride;b++){
+					c[b]|=carry[b];
+				}
+				return false;
+			}
+			const size_t d_i=distance(i);
+			if(d_i<d || (d_i==d && x<table[i])){
+				std::swap(x, table[i]);
+				std::swap_ranges(carry.begin(), carry.end(), c);
+				d=d_i;
+			}
+			i=(i+1) & mask;
+			d++;
+		}
+		table[i]=x;
+		std::copy(carry.begin(), carry.end(), &colors[i*stride]);
+		no_elements++;
+		return true;
+	}
+
+	void rehash(size_t new_capacity){
+		std::vector<_nkmer_T> old_table(new_capacity, empty_key());
+		std::vector<uint8_t> old_colors(new_capacity*stride, 0);
+		old_table.swap(table);
+		old_colors.swap(colors);
+		mask=new_capacity-1;
+		no_elements=0;
+		for(size_t i=0;i<old_table.size();i++){
+			if(old_table[i]!=empty_key()){
+				std::copy(&old_colors[i*stride], &old_colors[i*stride]+stride, carry.begin());
+				add(old_table[i]);
+			}
+		}
+	}
+};
+
+
+/*
+	Colored table split into the partitions of partitioned_kmer_set_t.
+*/
+template<typename _nkmer_T>
+class partitioned_kmer_color_table_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+	typedef kmer_color_table_t<_nkmer_T> partition_type;
+
+	static const int32_t partition_bits=partitioned_kmer_set_t<_nkmer_T>::partition_bits;
+
+	partitioned_kmer_color_table_t(int32_t no_colors, double _max_load_factor=0.75):
+		partitions(static_cast<size_t>(1) << partition_bits, partition_type(no_colors, _max_load_factor))
+	{
+	}
+
+	size_t no_partitions() const { return partitions.size(); }
+	partition_type &partition(size_t p){ return partitions[p]; }
+	const partition_type &partition(size_t p) const { return partitions[p]; }
+
+	size_t partition_of(const _nkmer_T &nkmer) const {
+		return static_cast<size_t>(kmer_hash(nkmer) >> (64-partition_bits));
+	}
+
+	size_t size() const {
+		size_t s=0;
+		for(const partition_type &part : partitions){
+			s+=part.size();
+		}
+		return s;
+	}
+
+	size_t capacity() const {
+		size_t c=0;
+		for(const partition_type &part : partitions){
+			c+=part.capacity();
+		}
+		return c;
+	}
+
+	void clear(){
+		for(partition_type &part : partitions){
+			part.clear();
+		}
+	}
+
+	void reserve(size_t n){
+		const size_t n_part=n/partitions.size() + n/partitions.size()/8 + 1;
+		for(partition_type &part : partitions){
+			part.reserve(n_part);
+		}
+	}
+
+	void set_color(int32_t c){
+		for(partition_type &part : partitions){
+			part.set_color(c);
+		}
+	}
+
+	bool insert(const _nkmer_T &nkmer){
+		return partitions[partition_of(nkmer)].insert(nkmer);
+	}
+
+	void add_probe_lengths(std::vector<uint64_t> &histogram) const {
+		for(const partition_type &part : partitions){
+			part.add_probe_lengths(histogram);
+		}
+	}
+
+private:
+	std::vector<partition_type> partitions;
+};
+
+
+/*
+	Insertion of the k-mers of one input into a colored table, with the
+	interface of a partitioned set (for the loaders). clear() and reserve()
+	do nothing, so that the k-mers of the other inputs are kept.
+*/
+template<typename _nkmer_T>
+class kmer_color_inserter_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+	typedef kmer_color_table_t<_nkmer_T> partition_type;
+
+	kmer_color_inserter_t(partitioned_kmer_color_table_t<_nkmer_T> &_table, int32_t color):
+		table(_table)
+	{
+		table.set_color(color);
+	}
+
+	size_t no_partitions() const { return table.no_partitions(); }
+	partition_type &partition(size_t p){ return table.partition(p); }
+
+	size_t partition_of(const _nkmer_T &nkmer) const {
+		return table.partition_of(nkmer);
+	}
+
+	bool insert(const _nkmer_T &nkmer){
+		return table.insert(nkmer);
+	}
+
+	size_t size() const { return table.size(); }
+	void clear(){}
+	void reserve(size_t){}
+
+private:
+	partitioned_kmer_color_table_t<_nkmer_T> &table;
+};
+
+#endif
@@ -0,0 +1,251 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Counting hash table of 2-bit encoded canonical k-mers, used to keep only
+	solid k-mers (occurring at least a given number of times) of read sets.
+
+	Every slot holds a k-mer and a saturating 8-bit counter stored in a
+	parallel array, i.e., one byte per k-mer on top of the key. The table
+	uses the same hashing and Robin Hood probing as kmer_set_t (insertions
+	only), and partitioned_kmer_counter_t the same partitioning as
+	partitioned_kmer_set_t, so partition p of a counter maps to partition p
+	of a set.
+*/
+
+#ifndef KMER_COUNTER_H
+#define KMER_COUNTER_H
+
+#include "kmer_set.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+
+template<typename _nkmer_T>
+class kmer_counter_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+
+	static const uint8_t max_count=255;
+
+	kmer_counter_t(double _max_load_factor=0.75):
+		table(min_capacity, empty_key()),
+		counts(min_capacity, 0),
+		mask(min_capacity-1),
+		no_elements(0),
+		max_load(_max_load_factor)
+	{
+		assert(0.0 < max_load && max_load < 1.0);
+	}
+
+	size_t size() const { return no_elements; }
+	bool empty() const { return no_elements==0; }
+	size_t capacity() const { return table.size(); }
+
+	void clear(){
+		std::vector<_nkmer_T>(min_capacity, empty_key()).swap(table);
+		std::vector<uint8_t>(min_capacity, 0).swap(counts);
+		mask=min_capacity-1;
+		no_elements=0;
+	}
+
+	void reserve(size_t n){
+		size_t new_capacity=min_capacity;
+		while(new_capacity*max_load < n+1){
+			new_capacity*=2;
+		}
+		if(new_capacity>table.size()){
+			rehash(new_capacity);
+		}
+	}
+
+	/* Count an occurrence of a k-mer. Return true if it was not present. */
+	bool insert(const _nkmer_T &nkmer){
+		assert(nkmer!=empty_key());
+		if((no_elements+1) > table.size()*max_load){
+			rehash(2*table.size());
+		}
+		return add(nkmer, 1);
+	}
+
+	/* Number of occurrences (saturated at max_count). */
+	uint8_t count_of(const _nkmer_T &nkmer) const {
+		size_t i=home_slot(nkmer);
+		size_t d=0;
+		while(table[i]!=empty_key()){
+			if(table[i]==nkmer){
+				return counts[i];
+			}
+			if(distance(i)<d){
+				break;
+			}
+			i=(i+1) & mask;
+			d++;
+		}
+		return 0;
+	}
+
+	/* Call f(nkmer, count) for all k-mers. */
+	template<typename _func_T>
+	void for_each(_func_T f) const {
+		for(size_t i=0;i<table.size();i++){
+			if(table[i]!=empty_key()){
+				f(table[i], counts[i]);
+			}
+		}
+	}
+
+private:
+	static const size_t min_capacity=16;
+
+	std::vector<_nkmer_T> table;
+	std::vector<uint8_t> counts;
+	size_t mask;
+	size_t no_elements;
+	double max_load;
+
+	static const _nkmer_T &empty_key(){
+		return kmer_set_t<_nkmer_T>::empty_key;
+	}
+
+	size_t home_slot(const _nkmer_T &nkmer) const {
+		return static_cast<size_t>(kmer_hash(nkmer)) & mask;
+	}
+
+	size_t distance(size_t i) const {
+		return (i-home_slot(table[i])) & mask;
+	}
+
+	bool add(const _nkmer_T &nkmer, uint8_t count){
+		_nkmer_T x=nkmer;
+		uint8_t c=count;
+		size_t i=home_slot(x);
+		size_t d=0;
+		while(table[i]!=empty_key()){
+			if(table[i]==x){
+				counts[i]=static_cast<uint8_t>(std::min<uint32_t>(max_count, counts[i]+c));
+				return false;
+			}
+			const size_t d_i=distance(i);
+			if(d_i<d){
+				std::swap(x, table[i]);
+				std::swap(c, counts[i]);
+				d=d_i;
+			}
+			i=(i+1) & mask;
+			d++;
+		}
+		table[i]=x;
+		counts[i]=c;
+		no_elements++;
+		return true;
+	}
+
+	void rehash(size_t new_capacity){
+		std::vector<_nkmer_T> old_table(new_capacity, empty_key());
+		std::vector<uint8_t> old_counts(new_capacity, 0);
+		old_table.swap(table);
+		old_counts.swap(counts);
+		mask=new_capacity-1;
+		no_elements=0;
+		for(size_t i=0;i<old_table.size();i++){
+			if(old_table[i]!=empty_key()){
+				add(old_table[i], old_counts[i]);
+			}
+		}
+	}
+};
+
+
+/*
+	Counter split into the partitions of partitioned_kmer_set_t.
+*/
+template<typename _nkmer_T>
+class partitioned_kmer_counter_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+	typedef kmer_counter_t<_nkmer_T> partition_type;
+
+	static const int32_t partition_bits=partitioned_kmer_set_t<_nkmer_T>::partition_bits;
+
+	partitioned_kmer_counter_t(double _max_load_factor=0.75):
+		partitions(static_cast<size_t>(1) << partition_bits, partition_type(_max_load_factor))
+	{
+	}
+
+	size_t no_partitions() const { return partitions.size(); }
+	partition_type &partition(size_t p){ return partitions[p]; }
+	const partition_type &partition(size_t p) const { return partitions[p]; }
+
+	size_t partition_of(const _nkmer_T &nkmer) const {
+		return static_cast<size_t>(kmer_hash(nkmer) >> (64-partition_bits));
+	}
+
+	size_t size() const {
+		size_t s=0;
+		for(const partition_type &part : partitions){
+			s+=part.size();
+		}
+		return s;
+	}
+
+	void clear(){
+		for(partition_type &part : partitions){
+			part.clear();
+		}
+	}
+
+	void reserve(size_t n){
+		const size_t n_part=n/partitions.size() + n/partitions.size()/8 + 1;
+		for(partition_type &part : partitions){
+			part.reserve(n_part);
+		}
+	}
+
+	bool insert(const _nkmer_T &nkmer){
+		return partitions[partition_of(nkmer)].insert(nkmer);
+	}
+
+	uint8_t count_of(const _nkmer_T &nkmer) const {
+		return partitions[partition_of(nkmer)].count_of(nkmer);
+	}
+
+private:
+	std::vector<partition_type> partitions;
+};
+
+#endif
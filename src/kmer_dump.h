@@ -0,0 +1,333 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Binary format of an encoded k-mer set, so that a set can be reused
+	without re-parsing FASTA files.
+
+	File layout (native byte order):
+
+		header (kmer_dump_header_t, 40 bytes)
+			magic       "PHKS"
+			version     1
+			k           k-mer size
+			width       width of the k-mer words in bits (64, 128, 256)
+			flags       bit 0: delta-compressed payload
+			reserved    0
+			count       number of k-mers
+			payload     size of the payload in bytes
+
+		payload
+			raw:    count k-mer words of width/8 bytes, sorted ascending
+			delta:  differences of consecutive k-mers (the first one
+			        against 0), each as a LEB128 varint
+
+	A raw payload is loaded by a single copy from the mapped file.
+
+	A dump is not trusted: the count must fit the payload, and the k-mers
+	must be strictly ascending and use only the low 2k bits (so that none
+	equals the empty key of the hash sets); otherwise the file is reported
+	as corrupted.
+*/
+
+#ifndef KMER_DUMP_H
+#define KMER_DUMP_H
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const char kmer_dump_magic[4]={'P','H','K','S'};
+static const uint32_t kmer_dump_version=1;
+static const uint32_t kmer_dump_flag_delta=0x1;
+
+struct kmer_dump_header_t{
+	char magic[4];
+	uint32_t version;
+	uint32_t k;
+	uint32_t width;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t count;
+	uint64_t payload;
+};
+
+static_assert(sizeof(kmer_dump_header_t)==40, "unexpected padding of the dump header");
+
+enum kmer_dump_error_t{
+	KMER_DUMP_OK=0,
+	KMER_DUMP_CANNOT_OPEN=-1,
+	KMER_DUMP_BAD_HEADER=-2,
+	KMER_DUMP_TRUNCATED=-3,
+	KMER_DUMP_WRITE_FAILED=-4,
+	KMER_DUMP_WRONG_WIDTH=-5,
+	KMER_DUMP_CORRUPTED=-6,
+};
+
+
+/*
+	Check whether a file starts with the magic of the binary format.
+*/
+inline bool is_kmer_dump(const std::string &fn){
+	if(fn=="-"){
+		return false;
+	}
+	FILE *fi=fopen(fn.c_str(),"rb");
+	if(fi==nullptr){
+		return false;
+	}
+	char magic[4];
+	const bool ok=fread(magic, 1, 4, fi)==4 && memcmp(magic, kmer_dump_magic, 4)==0;
+	fclose(fi);
+	return ok;
+}
+
+
+/*
+	Write a sorted array of k-mers.
+*/
+template<typename _nkmer_T>
+int32_t write_kmer_dump(FILE *fo, const _nkmer_T *kmers, size_t count, int32_t k, bool delta){
+	std::vector<uint8_t> payload;
+
+	if(delta){
+		payload.reserve(count*2);
+		_nkmer_T prev=0;
+		for(size_t i=0;i<count;i++){
+			_nkmer_T d=kmers[i]-prev;
+			prev=kmers[i];
+			while((d >> 7) != _nkmer_T(0)){
+				payload.push_back(static_cast<uint8_t>(static_cast<uint64_t>(d & _nkmer_T(0x7f)) | 0x80));
+				d >>= 7;
+			}
+			payload.push_back(static_cast<uint8_t>(static_cast<uint64_t>(d)));
+		}
+	}
+
+	kmer_dump_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kmer_dump_magic, 4);
+	header.version=kmer_dump_version;
+	header.k=k;
+	header.width=sizeof(_nkmer_T)*8;
+	header.flags=delta ? kmer_dump_flag_delta : 0;
+	header.count=count;
+	header.payload=delta ? payload.size() : count*sizeof(_nkmer_T);
+
+	bool ok=fwrite(&header, sizeof(header), 1, fo)==1;
+	if(delta){
+		ok=ok && fwrite(payload.data(), 1, payload.size(), fo)==payload.size();
+	}
+	else{
+		ok=ok && fwrite(kmers, sizeof(_nkmer_T), count, fo)==count;
+	}
+	return ok ? KMER_DUMP_OK : KMER_DUMP_WRITE_FAILED;
+}
+
+
+/*
+	Read-only view of a dump file (memory mapped).
+*/
+template<typename _nkmer_T>
+class kmer_dump_t{
+public:
+	kmer_dump_header_t header;
+
+	kmer_dump_t():
+		data(nullptr), length(0)
+	{
+		memset(&header, 0, sizeof(header));
+	}
+
+	~kmer_dump_t(){
+		close();
+	}
+
+	kmer_dump_t(const kmer_dump_t &)=delete;
+	kmer_dump_t &operator=(const kmer_dump_t &)=delete;
+
+	int32_t open(const std::string &fn){
+		close();
+
+		const int fd=::open(fn.c_str(), O_RDONLY);
+		if(fd<0){
+			return KMER_DUMP_CANNOT_OPEN;
+		}
+		struct stat st;
+		if(fstat(fd, &st)!=0){
+			::close(fd);
+			return KMER_DUMP_CANNOT_OPEN;
+		}
+		length=st.st_size;
+		if(length<sizeof(header)){
+			::close(fd);
+			return KMER_DUMP_TRUNCATED;
+		}
+		void *p=mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(p==MAP_FAILED){
+			return KMER_DUMP_CANNOT_OPEN;
+		}
+		data=static_cast<const uint8_t *>(p);
+
+		memcpy(&header, data, sizeof(header));
+		if(memcmp(header.magic, kmer_dump_magic, 4)!=0
+			|| header.version!=kmer_dump_version
+			|| (header.flags & ~kmer_dump_flag_delta)!=0)
+		{
+			return KMER_DUMP_BAD_HEADER;
+		}
+		if(header.width!=sizeof(_nkmer_T)*8){
+			return KMER_DUMP_WRONG_WIDTH;
+		}
+		if(header.k<1 || 2*header.k>header.width){
+			return KMER_DUMP_BAD_HEADER;
+		}
+		if(length-sizeof(header)<header.payload){
+			return KMER_DUMP_TRUNCATED;
+		}
+		/* a raw k-mer takes sizeof(_nkmer_T) bytes, a varint at least 1 */
+		if(delta() ? header.count>header.payload
+			: (header.payload%sizeof(_nkmer_T)!=0 || header.count!=header.payload/sizeof(_nkmer_T)))
+		{
+			return KMER_DUMP_CORRUPTED;
+		}
+		madvise(p, length, MADV_SEQUENTIAL);
+		return KMER_DUMP_OK;
+	}
+
+	void close(){
+		if(data!=nullptr){
+			munmap(const_cast<uint8_t *>(data), length);
+			data=nullptr;
+			length=0;
+		}
+	}
+
+	bool delta() const {
+		return (header.flags & kmer_dump_flag_delta)!=0;
+	}
+
+	size_t size() const {
+		return header.count;
+	}
+
+	/*
+		Call f for all k-mers (ascending). Stop at the first invalid one.
+	*/
+	template<typename _func_T>
+	int32_t for_each(_func_T f) const {
+		const uint8_t *p=payload();
+		const _nkmer_T mask=max_kmer();
+		if(!delta()){
+			_nkmer_T prev=0;
+			for(size_t i=0;i<header.count;i++){
+				_nkmer_T nkmer;
+				memcpy(&nkmer, p+i*sizeof(_nkmer_T), sizeof(_nkmer_T));
+				if(nkmer>mask || (i>0 && !(prev<nkmer))){
+					return KMER_DUMP_CORRUPTED;
+				}
+				f(nkmer);
+				prev=nkmer;
+			}
+			return KMER_DUMP_OK;
+		}
+
+		const uint8_t *end=p+header.payload;
+		_nkmer_T nkmer=0;
+		for(size_t i=0;i<header.count;i++){
+			_nkmer_T d=0;
+			int32_t shift=0;
+			uint8_t byte;
+			do{
+				if(p==end || shift>=static_cast<int32_t>(sizeof(_nkmer_T)*8)){
+					return KMER_DUMP_TRUNCATED;
+				}
+				byte=*p++;
+				d|=_nkmer_T(byte & 0x7f) << shift;
+				shift+=7;
+			} while(byte & 0x80);
+			/* a zero or overflowing difference breaks the order */
+			const _nkmer_T next=nkmer+d;
+			if(next>mask || (i>0 && !(nkmer<next))){
+				return KMER_DUMP_CORRUPTED;
+			}
+			nkmer=next;
+			f(nkmer);
+		}
+		return KMER_DUMP_OK;
+	}
+
+	/*
+		Copy all k-mers into a sorted array.
+	*/
+	int32_t copy_to(std::vector<_nkmer_T> &kmers) const {
+		if(!delta()){
+			kmers.resize(header.count);
+			if(header.count>0){
+				memcpy(kmers.data(), payload(), header.count*sizeof(_nkmer_T));
+			}
+			const _nkmer_T mask=max_kmer();
+			for(size_t i=0;i<kmers.size();i++){
+				if(kmers[i]>mask || (i>0 && !(kmers[i-1]<kmers[i]))){
+					kmers.clear();
+					return KMER_DUMP_CORRUPTED;
+				}
+			}
+			return KMER_DUMP_OK;
+		}
+		kmers.clear();
+		kmers.reserve(header.count);
+		return for_each([&](const _nkmer_T &nkmer){ kmers.push_back(nkmer); });
+	}
+
+private:
+	const uint8_t *data;
+	size_t length;
+
+	const uint8_t *payload() const {
+		return data+sizeof(header);
+	}
+
+	/* the largest valid k-mer word: the low 2k bits set, but never ~0 (the empty key) */
+	_nkmer_T max_kmer() const {
+		const _nkmer_T mask=(~_nkmer_T(0)) >> (header.width-2*header.k);
+		return mask==~_nkmer_T(0) ? mask-_nkmer_T(1) : mask;
+	}
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Streaming filter of a candidate k-mer set: the k-mers of another input
+	are passed to insert() (with the same interface as a partitioned set, so
+	that the usual loaders can be used), the occurrences of the candidates
+	are counted in one byte per hash table slot, and filter() keeps only the
+	candidates seen at least min_count times. The streamed k-mers are never
+	stored.
+*/
+
+#ifndef KMER_FILTER_H
+#define KMER_FILTER_H
+
+#include "kmer_set.h"
+#include "parallel.h"
+
+#include <cinttypes>
+#include <vector>
+
+
+template<typename _nkmer_T>
+class kmer_filter_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+
+	/* counts of the candidates of one partition of the candidate set */
+	class partition_t{
+	public:
+		bool insert(const _nkmer_T &nkmer){
+			const size_t slot=candidates->slot(nkmer);
+			if(slot==candidates->capacity()){
+				return false;
+			}
+			if(counts[slot]<max_count){
+				counts[slot]++;
+			}
+			return true;
+		}
+
+	private:
+		friend class kmer_filter_t;
+		kmer_set_t<_nkmer_T> *candidates;
+		std::vector<uint8_t> counts;
+	};
+
+	typedef partition_t partition_type;
+
+	static const uint8_t max_count=255;
+
+	kmer_filter_t(partitioned_kmer_set_t<_nkmer_T> &_candidates):
+		candidates(_candidates), partitions(_candidates.no_partitions())
+	{
+		for(size_t p=0;p<partitions.size();p++){
+			partitions[p].candidates=&candidates.partition(p);
+		}
+		clear();
+	}
+
+	size_t no_partitions() const { return partitions.size(); }
+	partition_t &partition(size_t p){ return partitions[p]; }
+
+	size_t partition_of(const _nkmer_T &nkmer) const {
+		return candidates.partition_of(nkmer);
+	}
+
+	bool insert(const _nkmer_T &nkmer){
+		return partitions[partition_of(nkmer)].insert(nkmer);
+	}
+
+	/* Number of candidates. */
+	size_t size() const {
+		return candidates.size();
+	}
+
+	/* Reset the counts; the candidates are not changed. */
+	void clear(){
+		for(partition_t &partition : partitions){
+			partition.counts.assign(partition.candidates->capacity(), 0);
+		}
+	}
+
+	void reserve(size_t){}
+
+	/*
+		Remove the candidates seen less than min_count times (the tables of
+		the partitions are rebuilt, one at a time) and reset the counts.
+	*/
+	void filter(int32_t min_count, int32_t threads){
+		run_tasks(partitions.size(), threads, [&](int32_t p){
+			partition_t &partition=partitions[p];
+			const kmer_set_t<_nkmer_T> &old_candidates=*partition.candidates;
+
+			size_t no_kept=0;
+			for(uint8_t count : partition.counts){
+				no_kept+=(count>=min_count);
+			}
+
+			kmer_set_t<_nkmer_T> kept(old_candidates.max_load_factor());
+			kept.reserve(no_kept);
+			for(size_t slot=0;slot<old_candidates.capacity();slot++){
+				if(partition.counts[slot]>=min_count){
+					kept.insert(old_candidates.at(slot));
+				}
+			}
+			*partition.candidates=std::move(kept);
+			partition.counts.assign(partition.candidates->capacity(), 0);
+		});
+	}
+
+private:
+	partitioned_kmer_set_t<_nkmer_T> &candidates;
+	std::vector<partition_t> partitions;
+};
+
+#endif
@@ -0,0 +1,535 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Open-addressing hash set for 2-bit encoded canonical k-mers.
+
+	Keys are stored directly in a flat power-of-two table (no per-element
+	nodes). Collisions are resolved by Robin Hood linear probing with ties
+	broken by the key, deletions by backward shifting (no tombstones). The
+	layout of the table then depends only on its content and capacity, not
+	on the order of insertions and deletions, so iteration is deterministic
+	even when the set is filled by several threads. The all-ones word is
+	reserved as the empty-slot sentinel; it is never a canonical k-mer (its
+	reverse complement is all zeros, which is smaller).
+
+	partitioned_kmer_set_t splits a set by hash into independent tables,
+	which can be filled and processed in parallel.
+
+	The interface is the subset of std::unordered_set used by prophasm.
+*/
+
+#ifndef KMER_SET_H
+#define KMER_SET_H
+
+#include "kmer_word.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+
+/*
+	Invertible 64-bit mixing function (finalizer of MurmurHash3).
+*/
+inline uint64_t kmer_hash(uint64_t x){
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+inline uint64_t kmer_hash(__uint128_t x){
+	return kmer_hash(static_cast<uint64_t>(x) ^ kmer_hash(static_cast<uint64_t>(x >> 64)));
+}
+
+template<int32_t _no_words>
+inline uint64_t kmer_hash(const multiword_t<_no_words> &x){
+	uint64_t h=0;
+	for(int32_t i=_no_words-1;i>=0;i--){
+		h=kmer_hash(h ^ x.w[i]);
+	}
+	return h;
+}
+
+
+template<typename _nkmer_T>
+class kmer_set_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+
+	class const_iterator{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef _nkmer_T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const _nkmer_T *pointer;
+		typedef const _nkmer_T &reference;
+
+		const_iterator(): set(nullptr), slot(0) {}
+		const_iterator(const kmer_set_t *_set, size_t _slot): set(_set), slot(_slot) {}
+
+		const _nkmer_T &operator*() const { return set->table[slot]; }
+		const _nkmer_T *operator->() const { return &set->table[slot]; }
+
+		const_iterator &operator++(){
+			slot=set->next_occupied(slot+1);
+			return *this;
+		}
+
+		const_iterator operator++(int){
+			const_iterator tmp(*this);
+			++(*this);
+			return tmp;
+		}
+
+		bool operator==(const const_iterator &other) const { return slot==other.slot; }
+		bool operator!=(const const_iterator &other) const { return slot!=other.slot; }
+
+	private:
+		friend class kmer_set_t;
+		const kmer_set_t *set;
+		size_t slot;
+	};
+
+	typedef const_iterator iterator;
+
+	static const _nkmer_T empty_key;
+
+	kmer_set_t(double _max_load_factor=0.75):
+		table(min_capacity, empty_key),
+		mask(min_capacity-1),
+		no_elements(0),
+		max_load(_max_load_factor),
+		first_hint(min_capacity)
+	{
+		assert(0.0 < max_load && max_load < 1.0);
+	}
+
+	size_t size() const { return no_elements; }
+	bool empty() const { return no_elements==0; }
+	size_t capacity() const { return table.size(); }
+	double load_factor() const { return static_cast<double>(no_elements)/table.size(); }
+	double max_load_factor() const { return max_load; }
+
+	void max_load_factor(double _max_load_factor){
+		assert(0.0 < _max_load_factor && _max_load_factor < 1.0);
+		max_load=_max_load_factor;
+		reserve(no_elements);
+	}
+
+	void clear(){
+		std::fill(table.begin(), table.end(), empty_key);
+		no_elements=0;
+		first_hint=table.size();
+	}
+
+	/* Make space for n elements without rehashing. */
+	void reserve(size_t n){
+		size_t new_capacity=min_capacity;
+		while(new_capacity*max_load < n+1){
+			new_capacity*=2;
+		}
+		if(new_capacity>table.size()){
+			rehash(new_capacity);
+		}
+	}
+
+	/* Insert a k-mer. Return true if it was not present. */
+	bool insert(const _nkmer_T &nkmer){
+		assert(nkmer!=empty_key);
+		if((no_elements+1) > table.size()*max_load){
+			rehash(2*table.size());
+		}
+
+		_nkmer_T x=nkmer;
+		size_t i=home_slot(x);
+		size_t d=0;
+		while(table[i]!=empty_key){
+			if(table[i]==x){
+				return false;
+			}
+			const size_t d_i=distance(i);
+			if(d_i<d || (d_i==d && x<table[i])){
+				/* x goes here, continue with the displaced element */
+				std::swap(x, table[i]);
+				d=d_i;
+				if(i<first_hint){
+					first_hint=i;
+				}
+			}
+			i=(i+1) & mask;
+			d++;
+		}
+		table[i]=x;
+		no_elements++;
+		if(i<first_hint){
+			first_hint=i;
+		}
+		return true;
+	}
+
+	size_t count(const _nkmer_T &nkmer) const {
+		return find_slot(nkmer)!=table.size() ? 1 : 0;
+	}
+
+	/*
+		Variants of count() and erase() with a precomputed hash (kmer_hash),
+		e.g., when the same k-mer is looked up in several sets.
+	*/
+	size_t count(const _nkmer_T &nkmer, uint64_t hash) const {
+		return find_slot(nkmer, hash)!=table.size() ? 1 : 0;
+	}
+
+	size_t erase(const _nkmer_T &nkmer, uint64_t hash){
+		const size_t i=find_slot(nkmer, hash);
+		if(i==table.size()){
+			return 0;
+		}
+		erase_slot(i);
+		return 1;
+	}
+
+	const_iterator find(const _nkmer_T &nkmer) const {
+		return const_iterator(this, find_slot(nkmer));
+	}
+
+	/* Slot of a k-mer (capacity() if absent), e.g., for per-slot annotations. */
+	size_t slot(const _nkmer_T &nkmer) const {
+		return find_slot(nkmer);
+	}
+
+	size_t slot(const _nkmer_T &nkmer, uint64_t hash) const {
+		return find_slot(nkmer, hash);
+	}
+
+	bool occupied(size_t slot) const {
+		return table[slot]!=empty_key;
+	}
+
+	const _nkmer_T &at(size_t slot) const {
+		return table[slot];
+	}
+
+	/* Remove a k-mer. Return the number of removed elements (0 or 1). */
+	size_t erase(const _nkmer_T &nkmer){
+		const size_t i=find_slot(nkmer);
+		if(i==table.size()){
+			return 0;
+		}
+		erase_slot(i);
+		return 1;
+	}
+
+	/* Add the distances of all elements from their home slots to a histogram. */
+	void add_probe_lengths(std::vector<uint64_t> &histogram) const {
+		for(size_t i=0;i<table.size();i++){
+			if(table[i]==empty_key){
+				continue;
+			}
+			const size_t d=distance(i);
+			if(d>=histogram.size()){
+				histogram.resize(d+1, 0);
+			}
+			histogram[d]++;
+		}
+	}
+
+	/*
+		The first occupied slot is searched from a cached lower bound, so
+		repeatedly taking and erasing begin() (as in assemble) costs O(capacity)
+		in total.
+	*/
+	const_iterator begin() const {
+		first_hint=next_occupied(first_hint);
+		return const_iterator(this, first_hint);
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, table.size());
+	}
+
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+
+private:
+	static const size_t min_capacity=16;
+
+	std::vector<_nkmer_T> table;
+	size_t mask;
+	size_t no_elements;
+	double max_load;
+
+	/* no occupied slot before this one */
+	mutable size_t first_hint;
+
+	size_t home_slot(const _nkmer_T &nkmer) const {
+		return static_cast<size_t>(kmer_hash(nkmer)) & mask;
+	}
+
+	/* Distance of the element in the given slot from its home slot. */
+	size_t distance(size_t i) const {
+		return (i-home_slot(table[i])) & mask;
+	}
+
+	/* Return the slot of the k-mer, or table.size() if absent. */
+	size_t find_slot(const _nkmer_T &nkmer) const {
+		return find_slot(nkmer, kmer_hash(nkmer));
+	}
+
+	size_t find_slot(const _nkmer_T &nkmer, uint64_t hash) const {
+		size_t i=static_cast<size_t>(hash) & mask;
+		size_t d=0;
+		while(table[i]!=empty_key){
+			if(table[i]==nkmer){
+				return i;
+			}
+			const size_t d_i=distance(i);
+			if(d_i<d || (d_i==d && nkmer<table[i])){
+				break;
+			}
+			i=(i+1) & mask;
+			d++;
+		}
+		return table.size();
+	}
+
+	size_t next_occupied(size_t i) const {
+		while(i<table.size() && table[i]==empty_key){
+			i++;
+		}
+		return i;
+	}
+
+	/*
+		Backward-shift deletion: move the following elements of the cluster
+		one slot back until an empty slot or an element in its home slot.
+	*/
+	void erase_slot(size_t i){
+		size_t j=(i+1) & mask;
+		while(table[j]!=empty_key && distance(j)>0){
+			table[i]=table[j];
+			i=j;
+			j=(j+1) & mask;
+		}
+		table[i]=empty_key;
+		no_elements--;
+	}
+
+	void rehash(size_t new_capacity){
+		std::vector<_nkmer_T> old_table(new_capacity, empty_key);
+		old_table.swap(table);
+		mask=new_capacity-1;
+		no_elements=0;
+		first_hint=new_capacity;
+		for(const _nkmer_T &nkmer : old_table){
+			if(nkmer!=empty_key){
+				insert(nkmer);
+			}
+		}
+	}
+};
+
+template<typename _nkmer_T>
+const _nkmer_T kmer_set_t<_nkmer_T>::empty_key=~_nkmer_T(0);
+
+
+/*
+	K-mer set split into 2^partition_bits kmer_set_t's by the highest bits of
+	the hash (the tables themselves use the lowest bits).
+
+	The number of partitions does not depend on the number of threads, hence
+	the iteration order (and the assembly) is the same for any -t.
+*/
+template<typename _nkmer_T>
+class partitioned_kmer_set_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+	typedef kmer_set_t<_nkmer_T> partition_type;
+
+	static const int32_t partition_bits=8;
+
+	class const_iterator{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef _nkmer_T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const _nkmer_T *pointer;
+		typedef const _nkmer_T &reference;
+
+		const_iterator(): set(nullptr), p(0) {}
+		const_iterator(const partitioned_kmer_set_t *_set, size_t _p, typename partition_type::const_iterator _it):
+			set(_set), p(_p), it(_it)
+		{
+			skip_empty();
+		}
+
+		const _nkmer_T &operator*() const { return *it; }
+		const _nkmer_T *operator->() const { return &(*it); }
+
+		const_iterator &operator++(){
+			++it;
+			skip_empty();
+			return *this;
+		}
+
+		const_iterator operator++(int){
+			const_iterator tmp(*this);
+			++(*this);
+			return tmp;
+		}
+
+		bool operator==(const const_iterator &other) const { return p==other.p && it==other.it; }
+		bool operator!=(const const_iterator &other) const { return !(*this==other); }
+
+	private:
+		const partitioned_kmer_set_t *set;
+		size_t p;
+		typename partition_type::const_iterator it;
+
+		void skip_empty(){
+			while(it==set->partitions[p].end() && p+1<set->partitions.size()){
+				p++;
+				it=set->partitions[p].begin();
+			}
+		}
+	};
+
+	typedef const_iterator iterator;
+
+	partitioned_kmer_set_t(double _max_load_factor=0.75):
+		partitions(static_cast<size_t>(1) << partition_bits, partition_type(_max_load_factor)),
+		first_hint(0)
+	{
+	}
+
+	size_t no_partitions() const { return partitions.size(); }
+	partition_type &partition(size_t p){
+		/* the partition can be modified directly */
+		first_hint=0;
+		return partitions[p];
+	}
+	const partition_type &partition(size_t p) const { return partitions[p]; }
+
+	size_t partition_of(const _nkmer_T &nkmer) const {
+		return partition_of_hash(kmer_hash(nkmer));
+	}
+
+	/* Partition of a k-mer with the given hash (kmer_hash). */
+	size_t partition_of_hash(uint64_t hash) const {
+		return static_cast<size_t>(hash >> (64-partition_bits));
+	}
+
+	size_t size() const {
+		size_t s=0;
+		for(const partition_type &part : partitions){
+			s+=part.size();
+		}
+		return s;
+	}
+
+	bool empty() const { return size()==0; }
+
+	size_t capacity() const {
+		size_t c=0;
+		for(const partition_type &part : partitions){
+			c+=part.capacity();
+		}
+		return c;
+	}
+
+	double load_factor() const { return static_cast<double>(size())/capacity(); }
+
+	void add_probe_lengths(std::vector<uint64_t> &histogram) const {
+		for(const partition_type &part : partitions){
+			part.add_probe_lengths(histogram);
+		}
+	}
+
+	void clear(){
+		for(partition_type &part : partitions){
+			part.clear();
+		}
+		first_hint=0;
+	}
+
+	void reserve(size_t n){
+		const size_t n_part=n/partitions.size() + n/partitions.size()/8 + 1;
+		for(partition_type &part : partitions){
+			part.reserve(n_part);
+		}
+	}
+
+	bool insert(const _nkmer_T &nkmer){
+		const size_t p=partition_of(nkmer);
+		if(p<first_hint){
+			first_hint=p;
+		}
+		return partitions[p].insert(nkmer);
+	}
+
+	size_t count(const _nkmer_T &nkmer) const {
+		return partitions[partition_of(nkmer)].count(nkmer);
+	}
+
+	size_t erase(const _nkmer_T &nkmer){
+		return partitions[partition_of(nkmer)].erase(nkmer);
+	}
+
+	const_iterator begin() const {
+		while(first_hint+1<partitions.size() && partitions[first_hint].empty()){
+			first_hint++;
+		}
+		return const_iterator(this, first_hint, partitions[first_hint].begin());
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, partitions.size()-1, partitions.back().end());
+	}
+
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+
+private:
+	std::vector<partition_type> partitions;
+
+	/* no element in partitions before this one */
+	mutable size_t first_hint;
+};
+
+#endif
@@ -0,0 +1,245 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Fixed-width words holding 2-bit encoded k-mers.
+
+	kmer_word<bits>::type is the word type used for k <= bits/2:
+		 64 bits: uint64_t     (k <= 32)
+		128 bits: __uint128_t  (k <= 64)
+		256 bits: multiword_t<4> (k <= 128)
+
+	multiword_t provides the integer operators needed by the encoding,
+	decoding and hashing functions (shifts, bitwise operations,
+	comparisons, and addition/subtraction for delta coding), so all k-mer
+	routines can be written once as templates.
+*/
+
+#ifndef KMER_WORD_H
+#define KMER_WORD_H
+
+#include <cinttypes>
+
+
+/*
+	Unsigned integer of _no_words 64-bit words (w[0] is the least significant).
+*/
+template<int32_t _no_words>
+struct multiword_t{
+	uint64_t w[_no_words];
+
+	multiword_t() = default;
+
+	multiword_t(uint64_t x){
+		w[0]=x;
+		for(int32_t i=1;i<_no_words;i++){
+			w[i]=0;
+		}
+	}
+
+	explicit operator uint64_t() const {
+		return w[0];
+	}
+
+	multiword_t &operator<<=(int32_t s){
+		if(0<s && s<64){
+			/* fast path (e.g., appending nucleotides) */
+			for(int32_t i=_no_words-1;i>0;i--){
+				w[i]=(w[i] << s) | (w[i-1] >> (64-s));
+			}
+			w[0]<<=s;
+			return *this;
+		}
+		const int32_t ws=s/64;
+		const int32_t bs=s%64;
+		for(int32_t i=_no_words-1;i>=0;i--){
+			uint64_t x=0;
+			if(i-ws>=0){
+				x=w[i-ws] << bs;
+				if(bs>0 && i-ws-1>=0){
+					x|=w[i-ws-1] >> (64-bs);
+				}
+			}
+			w[i]=x;
+		}
+		return *this;
+	}
+
+	multiword_t &operator>>=(int32_t s){
+		if(0<s && s<64){
+			for(int32_t i=0;i<_no_words-1;i++){
+				w[i]=(w[i] >> s) | (w[i+1] << (64-s));
+			}
+			w[_no_words-1]>>=s;
+			return *this;
+		}
+		const int32_t ws=s/64;
+		const int32_t bs=s%64;
+		for(int32_t i=0;i<_no_words;i++){
+			uint64_t x=0;
+			if(i+ws<_no_words){
+				x=w[i+ws] >> bs;
+				if(bs>0 && i+ws+1<_no_words){
+					x|=w[i+ws+1] << (64-bs);
+				}
+			}
+			w[i]=x;
+		}
+		return *this;
+	}
+
+	multiword_t &operator|=(const multiword_t &b){
+		for(int32_t i=0;i<_no_words;i++){
+			w[i]|=b.w[i];
+		}
+		return *this;
+	}
+
+	multiword_t &operator&=(const multiword_t &b){
+		for(int32_t i=0;i<_no_words;i++){
+			w[i]&=b.w[i];
+		}
+		return *this;
+	}
+
+	multiword_t &operator^=(const multiword_t &b){
+		for(int32_t i=0;i<_no_words;i++){
+			w[i]^=b.w[i];
+		}
+		return *this;
+	}
+
+	multiword_t &operator+=(const multiword_t &b){
+		uint64_t carry=0;
+		for(int32_t i=0;i<_no_words;i++){
+			const uint64_t x=w[i]+carry;
+			carry=(x<carry);
+			w[i]=x+b.w[i];
+			carry+=(w[i]<x);
+		}
+		return *this;
+	}
+
+	multiword_t &operator-=(const multiword_t &b){
+		uint64_t borrow=0;
+		for(int32_t i=0;i<_no_words;i++){
+			const uint64_t x=w[i]-b.w[i];
+			const uint64_t y=x-borrow;
+			borrow=(w[i]<b.w[i]) + (x<borrow);
+			w[i]=y;
+		}
+		return *this;
+	}
+
+	friend multiword_t operator<<(multiword_t a, int32_t s){ return a<<=s; }
+	friend multiword_t operator>>(multiword_t a, int32_t s){ return a>>=s; }
+	friend multiword_t operator|(multiword_t a, const multiword_t &b){ return a|=b; }
+	friend multiword_t operator&(multiword_t a, const multiword_t &b){ return a&=b; }
+	friend multiword_t operator^(multiword_t a, const multiword_t &b){ return a^=b; }
+	friend multiword_t operator+(multiword_t a, const multiword_t &b){ return a+=b; }
+	friend multiword_t operator-(multiword_t a, const multiword_t &b){ return a-=b; }
+
+	friend multiword_t operator~(multiword_t a){
+		for(int32_t i=0;i<_no_words;i++){
+			a.w[i]=~a.w[i];
+		}
+		return a;
+	}
+
+	friend bool operator==(const multiword_t &a, const multiword_t &b){
+		for(int32_t i=0;i<_no_words;i++){
+			if(a.w[i]!=b.w[i]){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	friend bool operator!=(const multiword_t &a, const multiword_t &b){
+		return !(a==b);
+	}
+
+	friend bool operator<(const multiword_t &a, const multiword_t &b){
+		for(int32_t i=_no_words-1;i>=0;i--){
+			if(a.w[i]!=b.w[i]){
+				return a.w[i]<b.w[i];
+			}
+		}
+		return false;
+	}
+
+	friend bool operator>(const multiword_t &a, const multiword_t &b){ return b<a; }
+	friend bool operator<=(const multiword_t &a, const multiword_t &b){ return !(b<a); }
+	friend bool operator>=(const multiword_t &a, const multiword_t &b){ return !(a<b); }
+};
+
+
+/*
+	Reverse the order of the 2-bit groups (nucleotides) of a word.
+*/
+inline uint64_t reverse_nucleotides(uint64_t x){
+	x=((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+	x=((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	return __builtin_bswap64(x);
+}
+
+inline __uint128_t reverse_nucleotides(__uint128_t x){
+	return (static_cast<__uint128_t>(reverse_nucleotides(static_cast<uint64_t>(x))) << 64)
+		| reverse_nucleotides(static_cast<uint64_t>(x >> 64));
+}
+
+template<int32_t _no_words>
+multiword_t<_no_words> reverse_nucleotides(const multiword_t<_no_words> &x){
+	multiword_t<_no_words> y;
+	for(int32_t i=0;i<_no_words;i++){
+		y.w[i]=reverse_nucleotides(x.w[_no_words-1-i]);
+	}
+	return y;
+}
+
+
+template<int32_t _bits>
+struct kmer_word;
+
+template<>
+struct kmer_word<64>{
+	typedef uint64_t type;
+};
+
+template<>
+struct kmer_word<128>{
+	typedef __uint128_t type;
+};
+
+template<>
+struct kmer_word<256>{
+	typedef multiword_t<4> type;
+};
+
+#endif
@@ -0,0 +1,281 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Implementation of libprophasm (libprophasm.h) by the k-mer engine of
+	prophasm (engine.h), without the command-line tool. A kmer_set_t holds a
+	partitioned_kmer_set_t of the word type selected by k (as in main).
+*/
+
+#include "engine.h"
+#include "libprophasm.h"
+
+
+namespace prophasm{
+
+struct kmer_set_t::impl_t{
+	int32_t k;
+
+	impl_t(int32_t _k): k(_k) {}
+	virtual ~impl_t(){}
+
+	virtual size_t size() const = 0;
+	virtual void clear() = 0;
+	virtual void add_sequence(const char *seq, size_t len) = 0;
+	virtual bool contains(const char *kmer) const = 0;
+	virtual int32_t load(const std::string &fn, int32_t threads) = 0;
+
+	/* Set operations; all sets have the same k (and word type). */
+	virtual void find_intersection(const std::vector<kmer_set_t> &sets, int32_t threads) = 0;
+	virtual void remove_from(std::vector<kmer_set_t> &sets, int32_t threads) const = 0;
+	virtual void extract_intersection(std::vector<kmer_set_t> &sets, int32_t threads) = 0;
+
+	virtual void assemble(const simplitig_callback_t &callback) = 0;
+};
+
+
+namespace{
+
+template<typename _nkmer_T>
+struct set_impl_t: public kmer_set_t::impl_t{
+	typedef partitioned_kmer_set_t<_nkmer_T> set_T;
+
+	set_T set;
+
+	set_impl_t(int32_t _k): impl_t(_k) {}
+
+	static set_T &set_of(kmer_set_t &s){
+		return static_cast<set_impl_t &>(s.impl()).set;
+	}
+
+	static const set_T &set_of(const kmer_set_t &s){
+		return static_cast<const set_impl_t &>(s.impl()).set;
+	}
+
+	size_t size() const { return set.size(); }
+	void clear(){ set.clear(); }
+
+	void add_sequence(const char *seq, size_t len){
+		engine::kmer_iterator_t<_nkmer_T> it(seq, len, k);
+		while(it.next()){
+			set.insert(it.canonical());
+		}
+	}
+
+	bool contains(const char *kmer) const {
+		_nkmer_T nkmer;
+		return engine::encode_canonical(kmer, k, nkmer)==0 && set.count(nkmer)>0;
+	}
+
+	int32_t load(const std::string &fn, int32_t threads){
+		const int32_t error_code=engine::kmers_from_fasta(fn, set, k, threads, nullptr, false);
+		if(error_code!=engine::LOAD_OK){
+			set.clear();
+		}
+		return error_code;
+	}
+
+	void find_intersection(const std::vector<kmer_set_t> &sets, int32_t threads){
+		std::vector<const set_T *> set_ptrs;
+		for(const kmer_set_t &s : sets){
+			set_ptrs.push_back(&set_of(s));
+		}
+		engine::find_intersection(set_ptrs, set, threads);
+	}
+
+	/*
+		The sets are moved into a vector of set_T for the routines of
+		engine.h and back (the partitions are not copied).
+	*/
+	static void swap_sets(std::vector<kmer_set_t> &sets, std::vector<set_T> &tmp){
+		tmp.resize(sets.size());
+		for(size_t i=0;i<sets.size();i++){
+			std::swap(set_of(sets[i]), tmp[i]);
+		}
+	}
+
+	void remove_from(std::vector<kmer_set_t> &sets, int32_t threads) const {
+		std::vector<set_T> tmp;
+		swap_sets(sets, tmp);
+		engine::remove_subset(tmp, set, threads);
+		swap_sets(sets, tmp);
+	}
+
+	void extract_intersection(std::vector<kmer_set_t> &sets, int32_t threads){
+		std::vector<set_T> tmp;
+		swap_sets(sets, tmp);
+		engine::extract_intersection(tmp, set, threads);
+		swap_sets(sets, tmp);
+	}
+
+	void assemble(const simplitig_callback_t &callback){
+		engine::assemble_simplitigs(set, k, callback);
+	}
+};
+
+}
+
+
+const char *error_message(int32_t error_code){
+	switch(error_code){
+		case PROPHASM_OK: return "no error";
+		case PROPHASM_INVALID_K: return "invalid k-mer size";
+		case PROPHASM_DIFFERENT_K: return "k-mer sets with different k";
+		case PROPHASM_NO_SETS: return "no k-mer sets";
+		case PROPHASM_CANNOT_OPEN: return "file could not be open";
+		case PROPHASM_CORRUPTED: return "file is corrupted or truncated";
+		default: return "unknown error";
+	}
+}
+
+
+kmer_set_t::kmer_set_t(int32_t k): k_(k){
+	if(k<1 || k>max_kmer_length){
+		return;
+	}
+	if(k<=32){
+		p.reset(new set_impl_t<kmer_word<64>::type>(k));
+	}
+	else if(k<=64){
+		p.reset(new set_impl_t<kmer_word<128>::type>(k));
+	}
+	else{
+		p.reset(new set_impl_t<kmer_word<256>::type>(k));
+	}
+}
+
+kmer_set_t::~kmer_set_t(){}
+
+kmer_set_t::kmer_set_t(kmer_set_t &&other): k_(other.k_), p(std::move(other.p)) {}
+
+kmer_set_t &kmer_set_t::operator=(kmer_set_t &&other){
+	k_=other.k_;
+	p=std::move(other.p);
+	return *this;
+}
+
+bool kmer_set_t::valid() const { return p!=nullptr; }
+int32_t kmer_set_t::k() const { return k_; }
+size_t kmer_set_t::size() const { return valid() ? p->size() : 0; }
+
+void kmer_set_t::clear(){
+	if(valid()){
+		p->clear();
+	}
+}
+
+int32_t kmer_set_t::add_sequence(const char *seq, size_t len){
+	if(!valid()){
+		return PROPHASM_INVALID_K;
+	}
+	p->add_sequence(seq, len);
+	return PROPHASM_OK;
+}
+
+int32_t kmer_set_t::add_sequence(const std::string &seq){
+	return add_sequence(seq.data(), seq.size());
+}
+
+bool kmer_set_t::contains(const char *kmer) const {
+	return valid() && p->contains(kmer);
+}
+
+
+/*
+	Check the sets of an operation: all valid and with the same k as set.
+*/
+static int32_t check_sets(const std::vector<kmer_set_t> &sets, const kmer_set_t &set){
+	if(!set.valid()){
+		return PROPHASM_INVALID_K;
+	}
+	for(const kmer_set_t &s : sets){
+		if(!s.valid()){
+			return PROPHASM_INVALID_K;
+		}
+		if(s.k()!=set.k()){
+			return PROPHASM_DIFFERENT_K;
+		}
+	}
+	return PROPHASM_OK;
+}
+
+int32_t kmers_from_fasta(const std::string &fn, kmer_set_t &set, int32_t threads){
+	if(!set.valid()){
+		return PROPHASM_INVALID_K;
+	}
+	switch(set.impl().load(fn, std::max(threads, 1))){
+		case engine::LOAD_OK: return PROPHASM_OK;
+		case engine::LOAD_CANNOT_OPEN: return PROPHASM_CANNOT_OPEN;
+		case engine::LOAD_WRONG_K: return PROPHASM_DIFFERENT_K;
+		default: return PROPHASM_CORRUPTED;
+	}
+}
+
+int32_t find_intersection(const std::vector<kmer_set_t> &sets, kmer_set_t &intersection, int32_t threads){
+	if(sets.empty()){
+		return PROPHASM_NO_SETS;
+	}
+	const int32_t error_code=check_sets(sets, intersection);
+	if(error_code!=PROPHASM_OK){
+		return error_code;
+	}
+	intersection.impl().find_intersection(sets, std::max(threads, 1));
+	return PROPHASM_OK;
+}
+
+int32_t remove_subset(std::vector<kmer_set_t> &sets, const kmer_set_t &subset, int32_t threads){
+	const int32_t error_code=check_sets(sets, subset);
+	if(error_code!=PROPHASM_OK){
+		return error_code;
+	}
+	subset.impl().remove_from(sets, std::max(threads, 1));
+	return PROPHASM_OK;
+}
+
+int32_t extract_intersection(std::vector<kmer_set_t> &sets, kmer_set_t &intersection, int32_t threads){
+	if(sets.empty()){
+		return PROPHASM_NO_SETS;
+	}
+	const int32_t error_code=check_sets(sets, intersection);
+	if(error_code!=PROPHASM_OK){
+		return error_code;
+	}
+	intersection.impl().extract_intersection(sets, std::max(threads, 1));
+	return PROPHASM_OK;
+}
+
+int32_t assemble(kmer_set_t &set, const simplitig_callback_t &callback){
+	if(!set.valid()){
+		return PROPHASM_INVALID_K;
+	}
+	set.impl().assemble(callback);
+	return PROPHASM_OK;
+}
+
+}
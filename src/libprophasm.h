@@ -0,0 +1,157 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	libprophasm: the k-mer loader, set operations and assembly of prophasm
+	for use in other programs, without files for the k-mer sets and the
+	simplitigs.
+
+	Usage:
+		prophasm::kmer_set_t a(31), b(31), x(31);
+		prophasm::kmers_from_fasta("a.fa", a);
+		b.add_sequence("ACGT...");
+
+		std::vector<prophasm::kmer_set_t> sets;
+		sets.push_back(std::move(a));
+		sets.push_back(std::move(b));
+		prophasm::extract_intersection(sets, x);
+
+		prophasm::assemble(x, [](const char *seq, size_t len){ ... });
+
+	The library never terminates the program: all functions return
+	PROPHASM_OK (0) on success and a negative error code otherwise (e.g., an
+	invalid k, sets with different k, or an input file that cannot be open
+	or is corrupted); error_message describes the code.
+
+	Build: make -C src lib (libprophasm.a, libprophasm.so); link with
+	-lprophasm -lz -pthread. Only the functions and classes declared here
+	are exported from libprophasm.so.
+*/
+
+#ifndef LIBPROPHASM_H
+#define LIBPROPHASM_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__)
+#define PROPHASM_API __attribute__((visibility("default")))
+#else
+#define PROPHASM_API
+#endif
+
+namespace prophasm{
+
+/* maximum k-mer size */
+const int32_t max_kmer_length=128;
+
+/* error codes */
+enum{
+	PROPHASM_OK=0,
+	PROPHASM_INVALID_K=-1,
+	PROPHASM_DIFFERENT_K=-2,
+	PROPHASM_NO_SETS=-3,
+	PROPHASM_CANNOT_OPEN=-4,
+	PROPHASM_CORRUPTED=-5,
+};
+
+/* Description of an error code. */
+PROPHASM_API const char *error_message(int32_t error_code);
+
+/* receives the simplitigs (seq is not 0-terminated) */
+typedef std::function<void(const char *seq, size_t len)> simplitig_callback_t;
+
+
+/*
+	Set of canonical k-mers (a partitioned hash set, as in prophasm).
+*/
+class PROPHASM_API kmer_set_t{
+public:
+	struct impl_t;
+
+	/*
+		1 <= k <= max_kmer_length; a set with another k is not valid: it
+		stays empty and all operations on it fail with PROPHASM_INVALID_K.
+	*/
+	explicit kmer_set_t(int32_t k);
+	~kmer_set_t();
+
+	kmer_set_t(kmer_set_t &&other);
+	kmer_set_t &operator=(kmer_set_t &&other);
+
+	bool valid() const;
+	int32_t k() const;
+	size_t size() const;
+	void clear();
+
+	/* Add the k-mers of a sequence (k-mers with non-ACGT characters are skipped). */
+	int32_t add_sequence(const char *seq, size_t len);
+	int32_t add_sequence(const std::string &seq);
+
+	/* Is the k-mer (k characters) or its reverse complement in the set? */
+	bool contains(const char *kmer) const;
+
+	impl_t &impl(){ return *p; }
+	const impl_t &impl() const { return *p; }
+
+private:
+	int32_t k_;
+	std::unique_ptr<impl_t> p;
+};
+
+
+/*
+	Replace the content of set by the k-mers of a FASTA/FASTQ file (possibly
+	gzipped, '-' for stdin) or of a binary k-mer set of prophasm. On an error,
+	the set is left empty.
+*/
+PROPHASM_API int32_t kmers_from_fasta(const std::string &fn, kmer_set_t &set, int32_t threads=1);
+
+/* K-mers present in all sets. */
+PROPHASM_API int32_t find_intersection(const std::vector<kmer_set_t> &sets, kmer_set_t &intersection, int32_t threads=1);
+
+/* Remove the k-mers of subset from all sets. */
+PROPHASM_API int32_t remove_subset(std::vector<kmer_set_t> &sets, const kmer_set_t &subset, int32_t threads=1);
+
+/* find_intersection and remove_subset in a single pass. */
+PROPHASM_API int32_t extract_intersection(std::vector<kmer_set_t> &sets, kmer_set_t &intersection, int32_t threads=1);
+
+/*
+	Greedy assembly of simplitigs, passed to callback one by one. The set is
+	emptied.
+*/
+PROPHASM_API int32_t assemble(kmer_set_t &set, const simplitig_callback_t &callback);
+
+}
+
+#endif
@@ -0,0 +1,145 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Read-only memory-mapped files and a vectorized newline search, used to
+	scan uncompressed FASTA files in place (without copying the sequences).
+*/
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cinttypes>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+class mapped_file_t{
+public:
+	mapped_file_t():
+		data_(nullptr), size_(0)
+	{}
+
+	~mapped_file_t(){
+		close();
+	}
+
+	mapped_file_t(const mapped_file_t &)=delete;
+	mapped_file_t &operator=(const mapped_file_t &)=delete;
+
+	/* Return 0 on success, -1 if the file cannot be mapped (e.g., a pipe). */
+	int32_t open(const std::string &fn){
+		close();
+
+		const int fd=::open(fn.c_str(), O_RDONLY);
+		if(fd<0){
+			return -1;
+		}
+		struct stat st;
+		if(fstat(fd, &st)!=0 || !S_ISREG(st.st_mode)){
+			::close(fd);
+			return -1;
+		}
+		size_=st.st_size;
+		if(size_==0){
+			::close(fd);
+			return 0;
+		}
+		void *p=mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(p==MAP_FAILED){
+			size_=0;
+			return -1;
+		}
+		madvise(p, size_, MADV_SEQUENTIAL);
+		data_=static_cast<const char *>(p);
+		return 0;
+	}
+
+	void close(){
+		if(data_!=nullptr){
+			munmap(const_cast<char *>(data_), size_);
+		}
+		data_=nullptr;
+		size_=0;
+	}
+
+	const char *begin() const { return data_; }
+	const char *end() const { return data_+size_; }
+	size_t size() const { return size_; }
+
+private:
+	const char *data_;
+	size_t size_;
+};
+
+
+/*
+	Return the first '\n' in [p, end), or end.
+*/
+inline const char *find_newline(const char *p, const char *end){
+#ifdef __SSE2__
+	const __m128i nl=_mm_set1_epi8('\n');
+	while(p+16<=end){
+		const __m128i block=_mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		const int mask=_mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+		if(mask!=0){
+			return p+__builtin_ctz(mask);
+		}
+		p+=16;
+	}
+#endif
+	while(p<end && *p!='\n'){
+		p++;
+	}
+	return p;
+}
+
+
+/*
+	Return the beginning of the line containing p-1 (i.e., of the line
+	ending just before p), or begin.
+*/
+inline const char *find_line_start(const char *begin, const char *p){
+	while(p>begin && *(p-1)!='\n'){
+		p--;
+	}
+	return p;
+}
+
+#endif
@@ -0,0 +1,303 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Output streams for the FASTA writer: a plain file, and a BGZF-compressed
+	file (blocked gzip as in samtools/htslib, readable by gzip, zcat and
+	bgzip).
+
+	BGZF blocks are compressed in parallel by a pool of threads while the
+	caller keeps producing data; the compressed blocks are written in their
+	original order by a dedicated thread.
+*/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "parallel.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class output_t{
+public:
+	virtual ~output_t(){}
+	virtual void write(const char *data, size_t len)=0;
+
+	/*
+		Flush all data and close the underlying file. Return false if any data
+		could not be written (errno is set to the error of the first failure).
+	*/
+	virtual bool close()=0;
+};
+
+
+class file_output_t: public output_t{
+public:
+	file_output_t(FILE *_file): file(_file), error(0) {}
+
+	~file_output_t(){
+		close();
+	}
+
+	void write(const char *data, size_t len){
+		if(error==0 && fwrite(data, 1, len, file)!=len){
+			error=errno;
+		}
+	}
+
+	bool close(){
+		if(file!=nullptr){
+			if(fclose(file)!=0 && error==0){
+				error=errno;
+			}
+			file=nullptr;
+		}
+		errno=error;
+		return error==0;
+	}
+
+private:
+	FILE *file;
+
+	/* errno of the first failed write (0 if none) */
+	int error;
+};
+
+
+/*
+	Compress one BGZF block. Return the compressed block (header, raw deflate
+	data, CRC32 and size).
+*/
+inline std::vector<char> bgzf_compress_block(const std::vector<char> &data, int32_t level){
+	const size_t header_size=18;
+	const size_t footer_size=8;
+	const size_t max_block_size=65536;
+
+	std::vector<char> block(max_block_size);
+	size_t deflated_size=0;
+
+	for(int32_t l : {level, 0}){
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		deflateInit2(&zs, l, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+		zs.next_in=reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+		zs.avail_in=data.size();
+		zs.next_out=reinterpret_cast<Bytef *>(block.data()+header_size);
+		zs.avail_out=max_block_size-header_size-footer_size;
+		const int ret=deflate(&zs, Z_FINISH);
+		deflated_size=zs.total_out;
+		deflateEnd(&zs);
+		if(ret==Z_STREAM_END){
+			break;
+		}
+		/* incompressible data did not fit, store it uncompressed */
+	}
+
+	const size_t block_size=header_size+deflated_size+footer_size;
+	const uint8_t header[header_size]={
+		0x1f, 0x8b, 8, 4,  0, 0, 0, 0,  0, 0xff,  6, 0,  'B', 'C', 2, 0,
+		static_cast<uint8_t>((block_size-1) & 0xff), static_cast<uint8_t>((block_size-1) >> 8)
+	};
+	memcpy(block.data(), header, header_size);
+
+	const uint32_t crc=crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(data.data()), data.size());
+	const uint32_t isize=data.size();
+	char *footer=block.data()+header_size+deflated_size;
+	for(int32_t i=0;i<4;i++){
+		footer[i]=(crc >> (8*i)) & 0xff;
+		footer[4+i]=(isize >> (8*i)) & 0xff;
+	}
+
+	block.resize(block_size);
+	return block;
+}
+
+
+class bgzf_output_t: public output_t{
+public:
+	/* uncompressed size of a block (as in htslib, the compressed block always fits into 64 kB) */
+	static const size_t block_data_size=0xff00;
+
+	bgzf_output_t(FILE *_file, int32_t threads, int32_t _level=Z_DEFAULT_COMPRESSION):
+		file(_file), level(_level), jobs(2*threads), next_submitted(0),
+		max_compressed(4*threads), next_written(0)
+	{
+		current.reserve(block_data_size);
+		for(int32_t i=0;i<threads;i++){
+			compressors.emplace_back(&bgzf_output_t::compress_blocks, this);
+		}
+		writer=std::thread(&bgzf_output_t::write_blocks, this);
+	}
+
+	~bgzf_output_t(){
+		close();
+	}
+
+	void write(const char *data, size_t len){
+		while(len>0){
+			const size_t n=std::min(len, block_data_size-current.size());
+			current.insert(current.end(), data, data+n);
+			data+=n;
+			len-=n;
+			if(current.size()==block_data_size){
+				submit();
+			}
+		}
+	}
+
+	bool close(){
+		if(file==nullptr){
+			errno=error;
+			return error==0;
+		}
+		if(!current.empty()){
+			submit();
+		}
+		jobs.close();
+		for(std::thread &t : compressors){
+			t.join();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished=true;
+		}
+		block_ready.notify_all();
+		writer.join();
+
+		/* empty block marking the end of the file */
+		static const uint8_t eof_block[28]={
+			0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 0x42, 0x43, 2, 0,
+			0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+		};
+		if(fwrite(eof_block, 1, sizeof(eof_block), file)!=sizeof(eof_block) && error==0){
+			error=errno;
+		}
+		if(fclose(file)!=0 && error==0){
+			error=errno;
+		}
+		file=nullptr;
+		errno=error;
+		return error==0;
+	}
+
+private:
+	struct job_t{
+		uint64_t id;
+		std::vector<char> data;
+	};
+
+	FILE *file;
+	int32_t level;
+
+	std::vector<char> current;
+	bounded_queue_t<job_t> jobs;
+	uint64_t next_submitted;
+
+	std::vector<std::thread> compressors;
+	std::thread writer;
+
+	/* compressed blocks waiting to be written */
+	std::mutex mutex;
+	std::condition_variable block_ready;
+	std::condition_variable block_written;
+	std::map< uint64_t, std::vector<char> > compressed;
+	size_t max_compressed;
+	uint64_t next_written;
+	bool finished=false;
+
+	/* errno of the first failed write (0 if none), set by the writer thread */
+	int error=0;
+
+	void submit(){
+		job_t job;
+		job.id=next_submitted++;
+		job.data.swap(current);
+		current.reserve(block_data_size);
+		jobs.push(std::move(job));
+	}
+
+	void compress_blocks(){
+		job_t job;
+		while(true){
+			{
+				/* do not get too far ahead of the writer */
+				std::unique_lock<std::mutex> lock(mutex);
+				block_written.wait(lock, [this]{ return compressed.size()<max_compressed; });
+			}
+			if(!jobs.pop(job)){
+				break;
+			}
+			std::vector<char> block=bgzf_compress_block(job.data, level);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				compressed[job.id].swap(block);
+			}
+			block_ready.notify_all();
+		}
+	}
+
+	void write_blocks(){
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true){
+			block_ready.wait(lock, [this]{ return compressed.count(next_written)>0 || finished; });
+			auto it=compressed.find(next_written);
+			if(it==compressed.end()){
+				/* finished and all blocks written */
+				break;
+			}
+			std::vector<char> block;
+			block.swap(it->second);
+			compressed.erase(it);
+			next_written++;
+			block_written.notify_all();
+
+			lock.unlock();
+			const bool written=error!=0 || fwrite(block.data(), 1, block.size(), file)==block.size();
+			const int write_error=errno;
+			lock.lock();
+			if(!written){
+				error=write_error;
+			}
+		}
+	}
+};
+
+#endif
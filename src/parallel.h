@@ -0,0 +1,126 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Helpers for multithreaded processing.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/*
+	Blocking FIFO queue with a bounded capacity (producers wait while it is
+	full, consumers while it is empty). After close(), pop() drains the
+	remaining items and then returns false.
+*/
+template<typename _T>
+class bounded_queue_t{
+public:
+	bounded_queue_t(size_t _capacity):
+		capacity(_capacity), closed(false)
+	{
+	}
+
+	void push(_T item){
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this]{ return items.size()<capacity; });
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+	}
+
+	bool pop(_T &item){
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this]{ return !items.empty() || closed; });
+		if(items.empty()){
+			return false;
+		}
+		item=std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	void close(){
+		std::lock_guard<std::mutex> lock(mutex);
+		closed=true;
+		not_empty.notify_all();
+	}
+
+private:
+	size_t capacity;
+	bool closed;
+	std::deque<_T> items;
+	std::mutex mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+};
+
+
+/*
+	Run task(i) for i=0..no_tasks-1 on a pool of no_workers threads. Tasks
+	are started in the order of their indices (each idle worker takes the
+	next one).
+*/
+template<typename _task_T>
+void run_tasks(int32_t no_tasks, int32_t no_workers, _task_T task){
+	if(no_workers<=1 || no_tasks<=1){
+		for(int32_t i=0;i<no_tasks;i++){
+			task(i);
+		}
+		return;
+	}
+
+	std::atomic<int32_t> next_task(0);
+	auto worker=[&](){
+		for(int32_t i=next_task++; i<no_tasks; i=next_task++){
+			task(i);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(int32_t i=0;i<std::min(no_workers,no_tasks);i++){
+		workers.emplace_back(worker);
+	}
+	for(std::thread &t : workers){
+		t.join();
+	}
+}
+
+#endif
@@ -34,11 +34,24 @@ Description:
 	de-Bruijn graphs.
 
 Todo:
-	* Find a library for sets of integers bigger than uint64_t (to support k-mers longer than 32).
 	* Optimize loading FASTA files.
 	* Check memory consumption (and put it here).
 */
-#include "kseq.h"
+#include "engine.h"
+#include "fasta_writer.h"
+#include "input.h"
+#include "kmer_buckets.h"
+#include "kmer_counter.h"
+#include "kmer_dump.h"
+#include "kmer_colors.h"
+#include "kmer_filter.h"
+#include "output.h"
+#include "kmer_set.h"
+#include "kmer_word.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "sorted_kmer_set.h"
+#include "stats.h"
 #include "version.h"
 
 #include <zlib.h>
@@ -49,45 +62,20 @@ Todo:
 #include <limits>
 #include <vector>
 #include <algorithm>
-#include <set>
 #include <cassert>
-#include <sstream>
-#include <unordered_set>
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <mutex>
+#include <thread>
 #include <getopt.h>
+#include <sys/stat.h>
 
-//typedef __uint128_t nkmer_t;
-typedef uint64_t nkmer_t;
-typedef std::set<nkmer_t> set_t;
-
-const int32_t fasta_line_length=60;
-const int32_t max_contig_length=10000000;
-const int32_t max_allowed_kmer_length=sizeof(nkmer_t)*4;
+const int32_t default_fasta_line_length=60;
 //const int32_t default_k=31;
 
-static const uint8_t nt4_nt256[] = "ACGTN";
-
-static const uint8_t nt256_nt4[] = {
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 0, 4, 1,  4, 4, 4, 2,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 0, 4, 1,  4, 4, 4, 2,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
-		4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4
-	};
-
-
-KSEQ_INIT(gzFile, gzread)
 
+using namespace prophasm::engine;
 
 void print_help(){
 	std::cerr <<
@@ -106,11 +94,32 @@ void print_help(){
 		"             - re-assemble f1 to g1\n" <<
 		"\n" <<
 		"Command-line parameters:\n" <<
-		" -k INT   K-mer size.\n" <<
-		" -i FILE  Input FASTA file (can be used multiple times).\n" <<
+		" -k INT   K-mer size (at most " << max_allowed_kmer_length << ").\n" <<
+		" -i FILE  Input FASTA file or binary k-mer set (can be used multiple times).\n" <<
 		" -o FILE  Output FASTA file (if used, must be used as many times as -i).\n" <<
 		" -x FILE  Compute intersection, subtract it, save it.\n" <<
-		" -s FILE  Output file with k-mer statistics.\n" <<
+		" -s FILE  Output file with k-mer statistics (incl. time and memory of all phases).\n" <<
+		" -m INT   Minimum number of occurrences of a k-mer in an input FASTA file\n" <<
+		"          (less frequent k-mers are ignored, e.g., sequencing errors). [1]\n" <<
+		" -l INT   Line length of output FASTA files (0 for no wrapping). [" << default_fasta_line_length << "]\n" <<
+		" -z       Compress output FASTA files by BGZF (default only for *.gz).\n" <<
+		" -b       Write k-mer sets in the binary format instead of simplitigs.\n" <<
+		" -d       Delta-compress binary k-mer sets (implies -b).\n" <<
+		" -t INT   Number of threads. [1]\n" <<
+		" -a       Use sorted arrays for k-mer sets (less memory, merge-based set operations).\n" <<
+		" -p       Parallel assembly with -t threads (deterministic, the same for any -t).\n" <<
+		" -g       Assemble k-mers grouped by minimizer into cache-sized buckets and stitch\n" <<
+		"          the results (with -t threads, deterministic).\n" <<
+		" -c       Load all inputs into one table of k-mers with the set of inputs containing\n" <<
+		"          them (less memory for similar inputs).\n" <<
+		" --max-mem SIZE\n" <<
+		"          External memory mode: k-mers are partitioned into buckets on disk\n" <<
+		"          (in $TMPDIR) so that the sets of one bucket fit into SIZE\n" <<
+		"          (suffixes K, M, G).\n" <<
+		" --candidates INT\n" <<
+		"          Intersection without -o is computed by streaming all inputs past the\n" <<
+		"          k-mers of the INT-th input (one set in memory, -a is not allowed,\n" <<
+		"          -p and -g apply to the assembly of the intersection). [smallest file]\n" <<
 		//" -k INT   K-mer size. [" << default_k << "]\n" <<
 		" -S       Silent mode.\n" <<
 		"\n" <<
@@ -125,428 +134,1601 @@ void test_file(FILE *fo, std::string fn){
 	}
 }
 
-template<typename _nkmer_T>
-int32_t encode_forward(const char *kmers, const int32_t k, _nkmer_T &nkmer){
-	nkmer=0;
-	for (int32_t i=0;i<k;i++){
-		uint8_t nt4 = nt256_nt4[static_cast<int32_t>(kmers[i])];
-		if (nt4==4){
-			return -1;
-		}
+/*
+	Errors of the loaders (engine.h) are fatal in the command-line tool.
+*/
+void test_load(int32_t error_code, const std::string &fn, int32_t k){
+	if(error_code==LOAD_CANNOT_OPEN){
+		std::cerr << "Error: file '" << fn << "' could not be open (error " << errno << ", " << strerror(errno) << ")." << std::endl;
+		exit(1);
+	}
+	if(error_code!=LOAD_OK){
+		std::cerr << "Error: " << load_error_message(error_code, fn, k) << "." << std::endl;
+		exit(1);
+	}
+}
+
+/*
+	Size of a file in bytes (the maximum value for stdin or if unknown).
+*/
+int64_t file_size(const std::string &fn){
+	struct stat st;
+	if(fn=="-" || stat(fn.c_str(), &st)!=0){
+		return std::numeric_limits<int64_t>::max();
+	}
+	return st.st_size;
+}
+
+/*
+	Parse a size with an optional suffix K, M, G or T (powers of 1024).
+	Return -1 if invalid.
+*/
+int64_t parse_size(const char *s){
+	char *end=nullptr;
+	const double value=strtod(s, &end);
+	if(end==s || value<0){
+		return -1;
+	}
+	double multiplier=1.0;
+	switch(toupper(*end)){
+		case '\0': break;
+		case 'K': multiplier=1024.0; break;
+		case 'M': multiplier=1024.0*1024; break;
+		case 'G': multiplier=1024.0*1024*1024; break;
+		case 'T': multiplier=1024.0*1024*1024*1024; break;
+		default: return -1;
+	}
+	if(*end!='\0' && *(end+1)!='\0' && !(toupper(*(end+1))=='B' && *(end+2)=='\0')){
+		return -1;
+	}
+	return static_cast<int64_t>(value*multiplier);
+}
+
+struct output_format_t{
+	/* length of sequence lines (0 = no wrapping) */
+	int32_t line_length;
+
+	/* BGZF-compress all outputs (otherwise only *.gz) */
+	bool gzip;
+
+	/* compression threads */
+	int32_t threads;
+};
+
+std::unique_ptr<output_t> open_output(const std::string &fasta_fn, const output_format_t &format){
+	FILE *file=nullptr;
+	if(fasta_fn=="-"){
+		file=stdout;
+	}
+	else{
+		file=fopen(fasta_fn.c_str(),"w+");
+		test_file(file, fasta_fn);
+	}
+
+	const std::string gz_suffix=".gz";
+	const bool gz_name=fasta_fn.size()>=gz_suffix.size() &&
+		fasta_fn.compare(fasta_fn.size()-gz_suffix.size(), gz_suffix.size(), gz_suffix)==0;
+
+	if(format.gzip || gz_name){
+		return std::unique_ptr<output_t>(new bgzf_output_t(file, format.threads));
+	}
+	else{
+		return std::unique_ptr<output_t>(new file_output_t(file));
+	}
+}
+
+/*
+	Close an output, exit if it could not be written completely.
+*/
+void close_output(output_t &out, const std::string &fasta_fn){
+	if(!out.close()){
+		std::cerr << "Error: file '" << fasta_fn << "' could not be written (error " << errno << ", " << strerror(errno) << ")." << std::endl;
+		exit(1);
+	}
+}
+
+template<typename _set_T>
+int assemble(const std::string &fasta_fn, _set_T &set, int32_t k, const output_format_t &format, FILE* fstats, bool verbose){
+	if(fstats){
+		fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+	}
+
+	std::unique_ptr<output_t> out=open_output(fasta_fn, format);
+	fasta_writer_t writer(*out, format.line_length);
+
+	int64_t contig_id=1;
+	assemble_simplitigs(set, k, [&](const char *seq, size_t len){
+		writer.write_record("c", contig_id, seq, len);
+		contig_id++;
+	});
+
+	writer.flush();
+	close_output(*out, fasta_fn);
+	print_output_stats(fstats, fasta_fn, k, writer.record_lengths());
 
-		nkmer <<= 2;
-		nkmer |= nt4;
+	if(verbose){
+		std::cerr << "   assembly finished (" << contig_id << " contigs)" << std::endl;
 	}
+
 	return 0;
+
 }
 
+
+/*
+	Simplitigs of the buckets of one output, stored in a temporary file
+	(external memory mode) or in memory until they are stitched. For every
+	piece, the (k-1)-mers leaving it at both
+	ends are kept: ends[2*i] is the reverse complement of the prefix of piece
+	i, ends[2*i+1] its suffix. Ends e1, e2 can be joined iff
+	ends[e1] is the reverse complement of ends[e2].
+*/
+template<typename _nkmer_T>
+struct simplitig_pieces_t{
+	int32_t k;
+
+	/* temporary file (none if in memory) */
+	std::string fn;
+	FILE *file;
+	std::string data;
+
+	/* piece i is stored at [offsets[i], offsets[i+1]) */
+	std::vector<uint64_t> offsets;
+	std::vector<_nkmer_T> ends;
+
+	simplitig_pieces_t(int32_t _k, const std::string &_fn=""):
+		k(_k), fn(_fn), file(nullptr), offsets(1, 0)
+	{
+		if(!fn.empty()){
+			file=fopen(fn.c_str(), "w+b");
+			test_file(file, fn);
+		}
+	}
+
+	~simplitig_pieces_t(){
+		if(file!=nullptr){
+			fclose(file);
+			unlink(fn.c_str());
+		}
+	}
+
+	size_t size() const {
+		return offsets.size()-1;
+	}
+
+	void add(const char *seq, size_t len){
+		assert(static_cast<int32_t>(len)>=k);
+		if(file==nullptr){
+			data.append(seq, len);
+		}
+		else if(fwrite(seq, 1, len, file)!=len){
+			std::cerr << "Error: temporary file '" << fn << "' could not be written (error " << errno << ", " << strerror(errno) << ")." << std::endl;
+			exit(1);
+		}
+		offsets.push_back(offsets.back()+len);
+
+		_nkmer_T left;
+		_nkmer_T right;
+		encode_reverse(seq, k-1, left);
+		encode_forward(seq+len-(k-1), k-1, right);
+		ends.push_back(left);
+		ends.push_back(right);
+	}
+
+	/* Append all pieces of another in-memory instance. */
+	void append(const simplitig_pieces_t &other){
+		assert(file==nullptr && other.file==nullptr);
+		data+=other.data;
+		for(size_t i=0;i<other.size();i++){
+			offsets.push_back(offsets.back()+other.offsets[i+1]-other.offsets[i]);
+		}
+		ends.insert(ends.end(), other.ends.begin(), other.ends.end());
+	}
+
+	/* Read piece i (reverse complemented if !forward). */
+	void read(size_t i, bool forward, std::string &seq){
+		seq.resize(offsets[i+1]-offsets[i]);
+		if(file==nullptr){
+			seq.assign(data, offsets[i], seq.size());
+		}
+		else if(fseeko(file, offsets[i], SEEK_SET)!=0 || fread(&seq[0], 1, seq.size(), file)!=seq.size()){
+			std::cerr << "Error: temporary file '" << fn << "' could not be read." << std::endl;
+			exit(1);
+		}
+		if(!forward){
+			std::reverse(seq.begin(), seq.end());
+			for(char &c : seq){
+				c=nt4_nt256[3-nt256_nt4[static_cast<uint8_t>(c)]];
+			}
+		}
+	}
+};
+
+
+/*
+	Join the pieces into paths (each end at most once, no cycles) and write
+	the paths as simplitigs.
+*/
 template<typename _nkmer_T>
-int32_t encode_reverse(const char *kmers, const int32_t k, _nkmer_T &nkmer){
-	nkmer=0;
-	for (int32_t i=0;i<k;i++){
-		uint8_t nt4 = nt256_nt4[static_cast<int32_t>(kmers[k-i-1])];
-		if (nt4==4){
-			return -1;
+int64_t write_stitched(const std::string &fasta_fn, simplitig_pieces_t<_nkmer_T> &pieces, int32_t k, const output_format_t &format, FILE* fstats){
+	const size_t no_pieces=pieces.size();
+	const size_t no_ends=2*no_pieces;
+	const std::vector<_nkmer_T> &ends=pieces.ends;
+
+	std::vector<_nkmer_T> canonical(no_ends);
+	for(size_t e=0;e<no_ends;e++){
+		canonical[e]=std::min(ends[e], reverse_complement_kmer(ends[e], k-1));
+	}
+	std::vector<size_t> order(no_ends);
+	for(size_t e=0;e<no_ends;e++){
+		order[e]=e;
+	}
+	std::stable_sort(order.begin(), order.end(),
+		[&](size_t a, size_t b){ return canonical[a]<canonical[b]; }
+	);
+
+	/* union-find over pieces, so that no cycle is closed */
+	std::vector<size_t> parent(no_pieces);
+	for(size_t i=0;i<no_pieces;i++){
+		parent[i]=i;
+	}
+	auto find=[&](size_t i){
+		while(parent[i]!=i){
+			parent[i]=parent[parent[i]];
+			i=parent[i];
+		}
+		return i;
+	};
+
+	const int64_t no_link=-1;
+	std::vector<int64_t> link(no_ends, no_link);
+	for(size_t g=0;g<no_ends;){
+		size_t h=g;
+		while(h<no_ends && canonical[order[h]]==canonical[order[g]]){
+			h++;
+		}
+		for(size_t a=g;a<h;a++){
+			const size_t e1=order[a];
+			for(size_t b=a+1;b<h && link[e1]==no_link;b++){
+				const size_t e2=order[b];
+				if(link[e2]!=no_link || ends[e1]!=reverse_complement_kmer(ends[e2], k-1)){
+					continue;
+				}
+				const size_t c1=find(e1/2);
+				const size_t c2=find(e2/2);
+				if(c1==c2){
+					continue;
+				}
+				parent[c1]=c2;
+				link[e1]=e2;
+				link[e2]=e1;
+			}
+		}
+		g=h;
+	}
+
+	std::unique_ptr<output_t> out=open_output(fasta_fn, format);
+	fasta_writer_t writer(*out, format.line_length);
+
+	std::vector<bool> visited(no_pieces, false);
+	std::string seq;
+	int64_t contig_id=1;
+	for(size_t i=0;i<no_pieces;i++){
+		if(visited[i] || (link[2*i]!=no_link && link[2*i+1]!=no_link)){
+			/* already written, or inside a path */
+			continue;
+		}
+		writer.begin_record("c", contig_id);
+		size_t piece=i;
+		bool forward=(link[2*i]==no_link);
+		bool first=true;
+		while(true){
+			visited[piece]=true;
+			pieces.read(piece, forward, seq);
+			const size_t skip=first ? 0 : k-1;
+			writer.append_sequence(seq.data()+skip, seq.size()-skip);
+			first=false;
+
+			const int64_t next=link[forward ? 2*piece+1 : 2*piece];
+			if(next==no_link){
+				break;
+			}
+			piece=next/2;
+			forward=(next%2==0);
+		}
+		writer.end_record();
+		contig_id++;
+	}
+	writer.flush();
+	close_output(*out, fasta_fn);
+	print_output_stats(fstats, fasta_fn, k, writer.record_lengths());
+
+	return contig_id-1;
+}
+
+
+/*
+	Claim flags for the k-mers of a partitioned set (one bit per table slot),
+	so that the k-mers can be taken from the set without modifying it. A
+	k-mer is addressed by its position: the partition and the slot. The
+	flags are read concurrently but set by one thread at a time.
+*/
+template<typename _set_T>
+struct kmer_claims_t{
+	typedef typename _set_T::value_type nkmer_T;
+
+	static const uint64_t absent=~0ULL;
+
+	const _set_T &set;
+	std::vector< std::vector< std::atomic<uint64_t> > > bits;
+
+	kmer_claims_t(const _set_T &_set): set(_set), bits(_set.no_partitions()) {
+		for(size_t p=0;p<bits.size();p++){
+			std::vector< std::atomic<uint64_t> > words((set.partition(p).capacity()+63)/64);
+			for(auto &w : words){
+				w.store(0);
+			}
+			bits[p].swap(words);
+		}
+	}
+
+	static uint64_t position(size_t p, size_t slot){
+		return (static_cast<uint64_t>(p) << 40) | slot;
+	}
+
+	/* Position of a k-mer, or absent if it is not in the set. */
+	uint64_t position(const nkmer_T &nkmer) const {
+		const uint64_t hash=kmer_hash(nkmer);
+		const size_t p=set.partition_of_hash(hash);
+		const size_t slot=set.partition(p).slot(nkmer, hash);
+		if(slot==set.partition(p).capacity()){
+			return absent;
+		}
+		return position(p, slot);
+	}
+
+	const nkmer_T &at(uint64_t pos) const {
+		return set.partition(pos >> 40).at(pos & ((1ULL << 40)-1));
+	}
+
+	bool claimed(uint64_t pos) const {
+		const uint64_t slot=pos & ((1ULL << 40)-1);
+		return (bits[pos >> 40][slot/64].load(std::memory_order_relaxed) >> (slot%64)) & 1;
+	}
+
+	void claim(uint64_t pos){
+		const uint64_t slot=pos & ((1ULL << 40)-1);
+		std::atomic<uint64_t> &word=bits[pos >> 40][slot/64];
+		word.store(word.load(std::memory_order_relaxed) | (1ULL << (slot%64)), std::memory_order_relaxed);
+	}
+};
+
+/*
+	Reservations of k-mers by the seeds of one round of the parallel
+	assembly: an open-addressing table from the positions of the k-mers
+	touched in the round to the lowest index of a seed that reached them.
+	The table is sized for the k-mers of one round, not for the set; the
+	slots used are recorded by the workers and emptied after the round.
+*/
+struct kmer_reservations_t{
+	static const uint64_t empty=~0ULL;
+	static const uint32_t none=~0U;
+
+	std::vector< std::atomic<uint64_t> > keys;
+	std::vector< std::atomic<uint32_t> > holders;
+	size_t mask;
+
+	/* max_kmers: the maximal number of k-mers reserved in a round */
+	kmer_reservations_t(size_t max_kmers){
+		size_t capacity=64;
+		while(capacity<2*max_kmers){
+			capacity*=2;
+		}
+		std::vector< std::atomic<uint64_t> > k(capacity);
+		std::vector< std::atomic<uint32_t> > h(capacity);
+		for(size_t i=0;i<capacity;i++){
+			k[i].store(empty);
+			h[i].store(none);
+		}
+		keys.swap(k);
+		holders.swap(h);
+		mask=capacity-1;
+	}
+
+	/*
+		Reserve a k-mer for a seed (the lowest seed keeps it). Return the
+		previous holder (none if the k-mer was free); slot is set to the slot
+		used.
+	*/
+	uint32_t reserve(uint64_t pos, uint32_t seed, size_t &slot){
+		size_t i=static_cast<size_t>(kmer_hash(pos)) & mask;
+		while(true){
+			uint64_t key=keys[i].load();
+			if(key==empty && keys[i].compare_exchange_strong(key, pos)){
+				break;
+			}
+			if(key==pos){
+				break;
+			}
+			i=(i+1) & mask;
+		}
+		slot=i;
+		uint32_t current=holders[i].load();
+		while(seed<current && !holders[i].compare_exchange_weak(current, seed)){
 		}
+		return current;
+	}
+
+	void clear(size_t slot){
+		keys[slot].store(empty, std::memory_order_relaxed);
+		holders[slot].store(none, std::memory_order_relaxed);
+	}
+};
+
+/* number of seeds of a round of the parallel assembly (adapted in this range) */
+const size_t parallel_assembly_min_seeds=1<<4;
+const size_t parallel_assembly_max_seeds=1<<14;
+
+/* maximal number of k-mers reserved in a round */
+const size_t parallel_assembly_round_kmers=1<<20;
+
+/*
+	Parallel assembly. The result is defined sequentially: the seeds are the
+	k-mers in the order of partitions and slots, and every seed not claimed
+	yet is extended greedily over the unclaimed k-mers, which it claims. It
+	therefore depends neither on the scheduling nor on the number of threads.
+
+	The seeds are processed in rounds. First, all seeds of a round are
+	extended in parallel over the k-mers unclaimed before the round
+	(speculation); a walk reserves its k-mers and stops at a k-mer reserved
+	by a lower seed or after its share of the round's reservations. Then the
+	seeds are committed in order by one thread, which replays the recorded
+	walk without any lookup in the set as long as its k-mers are still
+	unclaimed, and continues from where the speculation stopped. With one
+	thread, the seeds are extended directly.
+*/
+template<typename _set_T>
+int assemble_parallel(const std::string &fasta_fn, _set_T &set, int32_t k, const output_format_t &format, int32_t threads, FILE* fstats, bool verbose){
+	typedef typename _set_T::value_type nkmer_T;
+
+	if(fstats){
+		fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+	}
 
-		//complement
-		nt4 = 3-nt4;
+	std::unique_ptr<output_t> out=open_output(fasta_fn, format);
+	fasta_writer_t writer(*out, format.line_length);
+	const _set_T &const_set=set;
+	kmer_claims_t<_set_T> claims(const_set);
 
-		nkmer <<= 2;
-		nkmer |= nt4;
+	const size_t round_kmers=std::max<size_t>(std::min(parallel_assembly_round_kmers, set.size()), parallel_assembly_max_seeds);
+	std::unique_ptr<kmer_reservations_t> reservations;
+	if(threads>1){
+		reservations.reset(new kmer_reservations_t(round_kmers));
 	}
+
+	struct seed_t{
+		/* the k-mers taken by the speculation and their positions, the seed first */
+		std::vector<nkmer_T> path;
+		std::vector<uint64_t> positions;
+		/* the speculation stopped on its budget */
+		bool budget_exceeded;
+
+		seed_t(): budget_exceeded(false) {}
+	};
+
+	std::vector<uint64_t> candidates;
+	std::vector<seed_t> seeds(parallel_assembly_max_seeds);
+	std::vector< std::vector<size_t> > used_slots(threads);
+	size_t round_seeds=parallel_assembly_min_seeds;
+	size_t next_p=0;
+	size_t next_slot=0;
+	int32_t contig_id=1;
+
+	contig_t contig(k);
+	std::string central_kmer_string;
+
+	while(true){
+		candidates.clear();
+		while(candidates.size()<round_seeds && next_p<const_set.no_partitions()){
+			const typename _set_T::partition_type &partition=const_set.partition(next_p);
+			if(next_slot==partition.capacity()){
+				next_p++;
+				next_slot=0;
+				continue;
+			}
+			const uint64_t pos=claims.position(next_p, next_slot);
+			if(partition.occupied(next_slot) && !claims.claimed(pos)){
+				candidates.push_back(pos);
+			}
+			next_slot++;
+		}
+		if(candidates.empty()){
+			break;
+		}
+
+		const size_t budget=round_kmers/candidates.size();
+		if(threads>1){
+			std::atomic<size_t> next_seed(0);
+			run_tasks(threads, threads, [&](int32_t t){
+				contig_t contig(k);
+				std::string central_kmer_string;
+
+				for(size_t i=next_seed++;i<candidates.size();i=next_seed++){
+					seed_t &seed=seeds[i];
+					seed.path.clear();
+					seed.positions.clear();
+					seed.budget_exceeded=false;
+
+					size_t slot;
+					if(reservations->reserve(candidates[i], i, slot)<i){
+						/* reached by a lower seed */
+						used_slots[t].push_back(slot);
+						continue;
+					}
+					used_slots[t].push_back(slot);
+
+					const nkmer_T &central_nkmer=claims.at(candidates[i]);
+					seed.path.push_back(central_nkmer);
+					seed.positions.push_back(candidates[i]);
+					decode_kmer(central_nkmer,k,central_kmer_string);
+					contig.new_contig(central_kmer_string.c_str());
+
+					bool stopped=false;
+					extend_contig(contig, central_nkmer, k,
+						[&](const nkmer_T &nkmer){
+							if(stopped){
+								return false;
+							}
+							const uint64_t pos=claims.position(nkmer);
+							if(pos==claims.absent || claims.claimed(pos)){
+								return false;
+							}
+							if(seed.path.size()>=budget){
+								seed.budget_exceeded=true;
+								stopped=true;
+								return false;
+							}
+							const uint32_t holder=reservations->reserve(pos, i, slot);
+							if(holder==i){
+								/* already in this contig */
+								return false;
+							}
+							used_slots[t].push_back(slot);
+							if(holder<i){
+								/* the k-mer belongs to a lower seed */
+								stopped=true;
+								return false;
+							}
+							seed.path.push_back(nkmer);
+							seed.positions.push_back(pos);
+							return true;
+						}
+					);
+				}
+			});
+
+			run_tasks(threads, threads, [&](int32_t t){
+				for(const size_t slot : used_slots[t]){
+					reservations->clear(slot);
+				}
+				used_slots[t].clear();
+			});
+		}
+
+		size_t no_committed=0;
+		size_t no_exceeded=0;
+		for(size_t i=0;i<candidates.size();i++){
+			if(claims.claimed(candidates[i])){
+				continue;
+			}
+			const std::vector<nkmer_T> &path=seeds[i].path;
+			const std::vector<uint64_t> &positions=seeds[i].positions;
+			no_committed++;
+			no_exceeded+=seeds[i].budget_exceeded;
+
+			const nkmer_T &central_nkmer=claims.at(candidates[i]);
+			claims.claim(candidates[i]);
+			decode_kmer(central_nkmer,k,central_kmer_string);
+			contig.new_contig(central_kmer_string.c_str());
+
+			/*
+				The speculation made the same decisions while its k-mers are
+				unclaimed: the k-mers it rejected were claimed before the
+				round or already in the contig.
+			*/
+			size_t replayed=path.empty() ? 0 : 1;
+			extend_contig(contig, central_nkmer, k,
+				[&](const nkmer_T &nkmer){
+					if(replayed<path.size()){
+						if(nkmer!=path[replayed]){
+							return false;
+						}
+						if(!claims.claimed(positions[replayed])){
+							claims.claim(positions[replayed++]);
+							return true;
+						}
+						/* claimed by a lower seed of the round, continue directly */
+						replayed=path.size();
+						return false;
+					}
+					const uint64_t pos=claims.position(nkmer);
+					if(pos==claims.absent || claims.claimed(pos)){
+						return false;
+					}
+					claims.claim(pos);
+					return true;
+				}
+			);
+
+			writer.write_record("c", contig_id, contig.data(), contig.size());
+			contig_id++;
+		}
+
+		/*
+			Fewer seeds (a larger budget each) if many walks exceeded their
+			budget or most seeds were taken by the contigs of lower ones.
+		*/
+		if(4*no_exceeded>no_committed || 2*no_committed<candidates.size()){
+			round_seeds=std::max(round_seeds/2, parallel_assembly_min_seeds);
+		}
+		else{
+			round_seeds=std::min(2*round_seeds, parallel_assembly_max_seeds);
+		}
+	}
+
+	writer.flush();
+	close_output(*out, fasta_fn);
+	print_output_stats(fstats, fasta_fn, k, writer.record_lengths());
+	set.clear();
+
+	if(verbose){
+		std::cerr << "   assembly finished (" << contig_id << " contigs)" << std::endl;
+	}
+
 	return 0;
 }
 
+
+/*
+	Move all k-mers of a set into a vector (in a deterministic order).
+*/
+template<typename _set_T>
+void flatten_kmers(_set_T &set, std::vector<typename _set_T::value_type> &kmers, int32_t threads){
+	const size_t no_partitions=set.no_partitions();
+	std::vector<size_t> partition_begin(no_partitions+1, 0);
+	for(size_t p=0;p<no_partitions;p++){
+		partition_begin[p+1]=partition_begin[p]+set.partition(p).size();
+	}
+	kmers.resize(partition_begin[no_partitions]);
+	const _set_T &const_set=set;
+	run_tasks(no_partitions, threads, [&](int32_t p){
+		const typename _set_T::partition_type &partition=const_set.partition(p);
+		size_t j=partition_begin[p];
+		for(size_t slot=0;slot<partition.capacity();slot++){
+			if(partition.occupied(slot)){
+				kmers[j++]=partition.at(slot);
+			}
+		}
+	});
+	set.clear();
+}
+
 template<typename _nkmer_T>
-int32_t encode_canonical(const char *kmers, const int32_t k, _nkmer_T &nkmer){
-	_nkmer_T nkmer_f;
-	_nkmer_T nkmer_r;
+void flatten_kmers(sorted_kmer_set_t<_nkmer_T> &set, std::vector<_nkmer_T> &kmers, int32_t /*threads*/){
+	kmers.clear();
+	kmers.swap(set.kmers);
+}
 
-	int32_t error_code;
 
-	error_code=encode_forward(kmers, k, nkmer_f);
-	if(error_code!=0){
-		return error_code;
+/* k-mers per bucket of the bucketed assembly (the set of a bucket should fit into the L2 cache) */
+const size_t assembly_bucket_size=1<<16;
+
+/*
+	Bucketed assembly (-g). The k-mers are grouped by minimizer into
+	buckets; consecutive k-mers of a sequence mostly share their minimizer,
+	so nearly all extensions are looked up in a small table of one bucket.
+	The buckets are assembled independently (in parallel) and the resulting
+	pieces are stitched across buckets. The output does not depend on the
+	number of threads.
+*/
+template<typename _set_T>
+int assemble_bucketed(const std::string &fasta_fn, _set_T &set, int32_t k, const output_format_t &format, int32_t threads, FILE* fstats, bool verbose){
+	typedef typename _set_T::value_type nkmer_T;
+
+	if(fstats){
+		fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
 	}
 
-	error_code=encode_reverse(kmers, k, nkmer_r);
-	if(error_code!=0){
-		return error_code;
+	std::vector<nkmer_T> kmers;
+	flatten_kmers(set, kmers, threads);
+	const size_t n=kmers.size();
+
+	size_t no_buckets=1;
+	while(no_buckets*assembly_bucket_size<n){
+		no_buckets*=2;
+	}
+	const int32_t m=default_minimizer_length(k);
+
+	/* stable counting sort by bucket, over a fixed number of chunks */
+	const int32_t no_chunks=64;
+	auto chunk_begin=[&](int32_t c){ return n*c/no_chunks; };
+	std::vector<uint32_t> bucket_of(n);
+	std::vector< std::vector<size_t> > counts(no_chunks, std::vector<size_t>(no_buckets, 0));
+	run_tasks(no_chunks, threads, [&](int32_t c){
+		for(size_t i=chunk_begin(c);i<chunk_begin(c+1);i++){
+			bucket_of[i]=static_cast<uint32_t>(kmer_minimizer(kmers[i], k, m) & (no_buckets-1));
+			counts[c][bucket_of[i]]++;
+		}
+	});
+	std::vector<size_t> bucket_begin(no_buckets+1, 0);
+	size_t sum=0;
+	for(size_t b=0;b<no_buckets;b++){
+		bucket_begin[b]=sum;
+		for(int32_t c=0;c<no_chunks;c++){
+			const size_t count=counts[c][b];
+			counts[c][b]=sum;
+			sum+=count;
+		}
+	}
+	bucket_begin[no_buckets]=sum;
+	std::vector<nkmer_T> bucketed(n);
+	run_tasks(no_chunks, threads, [&](int32_t c){
+		for(size_t i=chunk_begin(c);i<chunk_begin(c+1);i++){
+			bucketed[counts[c][bucket_of[i]]++]=kmers[i];
+		}
+	});
+	std::vector<nkmer_T>().swap(kmers);
+	std::vector<uint32_t>().swap(bucket_of);
+	counts.clear();
+
+	/* simplitigs of every bucket, concatenated in the order of the buckets */
+	std::vector< std::unique_ptr< simplitig_pieces_t<nkmer_T> > > bucket_pieces(no_buckets);
+	run_tasks(no_buckets, threads, [&](int32_t b){
+		kmer_set_t<nkmer_T> bucket_set;
+		bucket_set.reserve(bucket_begin[b+1]-bucket_begin[b]);
+		for(size_t i=bucket_begin[b];i<bucket_begin[b+1];i++){
+			bucket_set.insert(bucketed[i]);
+		}
+		bucket_pieces[b].reset(new simplitig_pieces_t<nkmer_T>(k));
+		assemble_simplitigs(bucket_set, k, [&](const char *seq, size_t len){ bucket_pieces[b]->add(seq, len); });
+	});
+	std::vector<nkmer_T>().swap(bucketed);
+
+	simplitig_pieces_t<nkmer_T> pieces(k);
+	for(std::unique_ptr< simplitig_pieces_t<nkmer_T> > &bp : bucket_pieces){
+		pieces.append(*bp);
+		bp.reset();
 	}
 
-	nkmer=std::min(nkmer_f,nkmer_r);
+	const int64_t no_contigs=write_stitched(fasta_fn, pieces, k, format, fstats);
+
+	if(verbose){
+		std::cerr << "   assembly finished (" << no_buckets << " buckets, " << pieces.size() << " pieces stitched into " << no_contigs << " contigs)" << std::endl;
+	}
 
 	return 0;
 }
 
+
+/*
+	Write a k-mer set in the binary format instead of assembling it.
+*/
 template<typename _nkmer_T>
-int32_t decode_kmer(_nkmer_T nkmer, int32_t k, std::string &kmer){
-	kmer.resize(k);
-	for(int32_t i=0;i<k;i++){
-		uint8_t nt4 = nkmer & 0x3;
-		nkmer >>=2;
-		kmer[k-i-1]=nt4_nt256[nt4];
+int dump_kmers(const std::string &fn, const _nkmer_T *kmers, size_t count, int32_t k, bool delta, FILE* fstats, bool verbose){
+	if(fstats){
+		fprintf(fstats,"%s\t%lu\n",fn.c_str(),count);
+	}
+
+	FILE *file=nullptr;
+	if(fn=="-"){
+		file=stdout;
+	}
+	else{
+		file=fopen(fn.c_str(),"wb");
+		test_file(file, fn);
+	}
+
+	if(write_kmer_dump(file, kmers, count, k, delta)!=KMER_DUMP_OK){
+		std::cerr << "Error: binary k-mer set '" << fn << "' could not be written (error " << errno << ", " << strerror(errno) << ")." << std::endl;
+		exit(1);
+	}
+
+	if((file==stdout ? fflush(file) : fclose(file))!=0){
+		std::cerr << "Error: binary k-mer set '" << fn << "' could not be written (error " << errno << ", " << strerror(errno) << ")." << std::endl;
+		exit(1);
+	}
+
+	if(verbose){
+		std::cerr << "   binary k-mer set written (" << count << " k-mers)" << std::endl;
 	}
 
 	return 0;
 }
 
-void reverse_complement_in_place(std::string &kmer){
-	//std::cerr << "before reverse complementing " << kmer << std::endl;
-    std::reverse(kmer.begin(), kmer.end());
-	for (int32_t i=0;i<static_cast<int32_t>(kmer.size());i++){
-		char nt4=nt256_nt4[static_cast<int32_t>(kmer[i])];
-		if (nt4<4){
-			nt4=3-nt4;
-		}
-		kmer[i]=nt4_nt256[static_cast<int32_t>(nt4)];
+template<typename _set_T>
+int dump_kmers(const std::string &fn, _set_T &set, int32_t k, bool delta, int32_t threads, FILE* fstats, bool verbose){
+	std::vector<typename _set_T::value_type> kmers;
+	kmers.reserve(set.size());
+	for(const auto &nkmer : set){
+		kmers.push_back(nkmer);
 	}
-	//std::cerr << "after reverse complementing " << kmer << std::endl;
+	set.clear();
+	radix_sort_kmers(kmers, k, threads);
+	return dump_kmers(fn, kmers.data(), kmers.size(), k, delta, fstats, verbose);
 }
 
+template<typename _nkmer_T>
+int dump_kmers(const std::string &fn, sorted_kmer_set_t<_nkmer_T> &set, int32_t k, bool delta, int32_t /*threads*/, FILE* fstats, bool verbose){
+	return dump_kmers(fn, set.kmers.data(), set.kmers.size(), k, delta, fstats, verbose);
+}
+
+
+struct params_t{
+	int32_t k;
+	int32_t min_count;
+	int32_t threads;
+	int32_t line_length;
+	int32_t no_sets;
+
+	std::vector<std::string> in_fns;
+	std::vector<std::string> out_fns;
+	std::string intersection_fn;
+	FILE *fstats;
+
+	bool compute_intersection;
+	bool compute_output;
+	bool sorted_sets;
+	bool parallel_assembly;
+	bool bucketed_assembly;
+	bool colored;
+	bool gzip;
+	bool binary_output;
+	bool delta_output;
+	bool verbose;
+
+	/* memory limit of the external memory mode (0 = in memory) */
+	int64_t max_mem;
+
+	/* candidate input of the streaming intersection (-1 = the smallest file) */
+	int32_t candidates;
+};
+
+
+/*
+	Sorted sets are converted back to a hash set for assembly.
+*/
+template<typename _nkmer_T>
+void move_to_hash_set(sorted_kmer_set_t<_nkmer_T> &set, partitioned_kmer_set_t<_nkmer_T> &hash_set){
+	hash_set.reserve(set.size());
+	for(const _nkmer_T &nkmer : set){
+		hash_set.insert(nkmer);
+	}
+	set.clear();
+}
+
+template<typename _nkmer_T>
+int assemble(const std::string &fasta_fn, sorted_kmer_set_t<_nkmer_T> &set, int32_t k, const output_format_t &format, FILE* fstats, bool verbose){
+	partitioned_kmer_set_t<_nkmer_T> hash_set;
+	move_to_hash_set(set, hash_set);
+	return assemble(fasta_fn, hash_set, k, format, fstats, verbose);
+}
+
+template<typename _nkmer_T>
+int assemble_parallel(const std::string &fasta_fn, sorted_kmer_set_t<_nkmer_T> &set, int32_t k, const output_format_t &format, int32_t threads, FILE* fstats, bool verbose){
+	partitioned_kmer_set_t<_nkmer_T> hash_set;
+	move_to_hash_set(set, hash_set);
+	return assemble_parallel(fasta_fn, hash_set, k, format, threads, fstats, verbose);
+}
+
+
+/*
+	Occupancy of the hash tables of k-mer sets (none for sorted sets).
+*/
 template<typename _set_T>
-void debug_print_kmer_set(_set_T &set, int k, bool verbose){
-	std::string kmer;
-	for(auto x: set){
-		decode_kmer(x, k, kmer);
-		if(verbose){
-			std::cerr << x << " " << kmer << ";  ";
-		}
+void add_table_stats(const _set_T &set, table_stats_t &tables){
+	tables.size+=set.size();
+	tables.capacity+=set.capacity();
+	set.add_probe_lengths(tables.probe_lengths);
+}
+
+template<typename _nkmer_T>
+void add_table_stats(const sorted_kmer_set_t<_nkmer_T> &/*set*/, table_stats_t &/*tables*/){
+}
+
+
+/*
+	Write an output k-mer set (simplitigs or a binary k-mer set).
+*/
+template<typename _set_T>
+void assemble_output(const std::string &fasta_fn, _set_T &set, const params_t &params){
+	output_format_t format;
+	format.line_length=params.line_length;
+	format.gzip=params.gzip;
+	format.threads=params.threads;
+
+	if(params.binary_output){
+		dump_kmers(fasta_fn, set, params.k, params.delta_output, params.threads, params.fstats, params.verbose);
 	}
-	if(verbose){
-		std::cerr<<std::endl;
+	else if(params.bucketed_assembly){
+		assemble_bucketed(fasta_fn, set, params.k, format, params.threads, params.fstats, params.verbose);
+	}
+	else if(params.parallel_assembly){
+		assemble_parallel(fasta_fn, set, params.k, format, params.threads, params.fstats, params.verbose);
+	}
+	else{
+		assemble(fasta_fn, set, params.k, format, params.fstats, params.verbose);
 	}
 }
 
 
-struct contig_t{
-	int32_t k;
+/*
+	Load, intersect, subtract and assemble; _set_T is the container of the
+	k-mer sets and _nkmer_T the k-mer word type (selected in main according
+	to k).
+*/
+template<typename _nkmer_T, typename _set_T>
+int32_t run_pipeline(const params_t &params){
+	std::vector<_set_T> full_sets(params.no_sets);
 
-	/* contig buffer */
-	char *seq_buffer;
+	if(params.verbose){
+		std::cerr << "=====================" << std::endl;
+		std::cerr << "1) Loading references" << std::endl;
+		std::cerr << "=====================" << std::endl;
+	}
 
-	/* the first position of the contig */
-	char *l_ext;
 
-	/* the last position of the contig +1 (semiopen ) */
-	char *r_ext;
+	std::vector<int32_t> in_sizes;
+	std::vector<int32_t> out_sizes;
 
-	/* min possible value of l_ext */
-	char *l_ext_border;
+	phase_timer_t timer;
+	table_stats_t tables;
+	uint64_t loaded_kmers=0;
 
-	/* max possible value of l_ext */
-	char *r_ext_border;
+	/*
+		Inputs are loaded concurrently, the largest files first; the threads
+		are split between the files being loaded. Statistics are printed
+		afterwards in the order of the inputs.
+	*/
+	std::vector<int32_t> load_order(params.no_sets);
+	std::vector<int64_t> file_sizes(params.no_sets);
+	for(int32_t i=0;i<params.no_sets;i++){
+		load_order[i]=i;
+		file_sizes[i]=file_size(params.in_fns[i]);
+	}
+	std::stable_sort(load_order.begin(), load_order.end(),
+		[&](int32_t a, int32_t b){ return file_sizes[a]>file_sizes[b]; }
+	);
+
+	const int32_t no_loaders=std::max(1, std::min(params.threads, params.no_sets));
+	const int32_t threads_per_loader=std::max(1, params.threads/no_loaders);
+	run_tasks(params.no_sets, no_loaders, [&](int32_t j){
+		const int32_t i=load_order[j];
+		test_load(load_kmers(params.in_fns[i],full_sets[i],params.k,params.min_count,threads_per_loader,params.verbose), params.in_fns[i], params.k);
+	});
+
+	for(int32_t i=0;i<params.no_sets;i++){
+		if(params.fstats){
+			fprintf(params.fstats,"%s\t%lu\n",params.in_fns[i].c_str(),full_sets[i].size());
+		}
+		in_sizes.insert(in_sizes.end(),full_sets[i].size());
+		loaded_kmers+=full_sets[i].size();
+		add_table_stats(full_sets[i], tables);
+	}
+	timer.print(params.fstats, "load", loaded_kmers, tables);
 
-	contig_t(uint32_t _k){
-		this->k=_k;
-		seq_buffer=new char[k+2*max_contig_length+1]();
-		l_ext_border=seq_buffer;
-		r_ext_border=seq_buffer+2*max_contig_length;
+	if(params.verbose){
+		std::cerr << "===============" << std::endl;
+		std::cerr << "2) Intersecting" << std::endl;
+		std::cerr << "===============" << std::endl;
 	}
 
-	int32_t new_contig(const char *base_kmer){
-		assert(static_cast<int32_t>(strlen(base_kmer))==k);
 
-		l_ext = r_ext = &seq_buffer[max_contig_length];
-		*r_ext='\0';
+	_set_T intersection;
 
-		for(int32_t i=0;i<k;i++){
-			r_extend(base_kmer[i]);
+	int32_t intersection_size = 0;
+
+	if(params.compute_intersection){
+		timer.restart();
+		tables=table_stats_t();
+		if(params.compute_output){
+			if (params.verbose){
+				std::cerr << "2.1) Computing intersection and removing it from all kmer sets" << std::endl;
+			}
+			extract_intersection(full_sets, intersection, params.threads);
+			for(int32_t i=0;i<params.no_sets;i++){
+				add_table_stats(full_sets[i], tables);
+			}
+		}
+		else{
+			if (params.verbose){
+				std::cerr << "2.1) Computing intersection" << std::endl;
+			}
+			find_intersection(full_sets, intersection, params.threads);
+		}
+		intersection_size  = intersection.size();
+		add_table_stats(intersection, tables);
+		timer.print(params.fstats, params.compute_output ? "intersect_subtract" : "intersect", loaded_kmers, tables);
+		if (params.verbose){
+			std::cerr << "   intersection size: " <<  intersection_size << std::endl;
 		}
-		return 0;
 	}
 
-	int32_t r_extend(char c){
-		uint8_t nt4 = nt256_nt4[static_cast<int32_t>(c)];
-
-		if (nt4==4){
-			return -1;
+	if(params.compute_output){
+		for (int32_t i=0;i<params.no_sets;i++){
+			out_sizes.insert(out_sizes.end(),full_sets[i].size());
+			assert(in_sizes[i]==out_sizes[i]+intersection_size);
+			if (params.verbose){
+				std::cerr << in_sizes[i] << " " << out_sizes[i] << " ...inter:" << intersection_size << std::endl;
+			}
 		}
+	}
 
-		*r_ext=nt4_nt256[nt4];
-		++r_ext;
-		*r_ext='\0';
-		return 0;
+	if(params.verbose){
+		std::cerr << "=============" << std::endl;
+		std::cerr << "3) Assembling" << std::endl;
+		std::cerr << "=============" << std::endl;
 	}
 
-	int32_t l_extend(char c){
-		uint8_t nt4 = nt256_nt4[static_cast<int32_t>(c)];
+	timer.restart();
+	uint64_t assembled_kmers=0;
+	if(params.compute_output){
+		for(int32_t i=0;i<static_cast<int32_t>(params.in_fns.size());i++){
+			assembled_kmers+=full_sets[i].size();
+			assemble_output(params.out_fns[i], full_sets[i], params);
+		}
+	}
+	if(params.compute_intersection){
+		assembled_kmers+=intersection.size();
+		assemble_output(params.intersection_fn, intersection, params);
+	}
+	timer.print(params.fstats, params.binary_output ? "write" : "assemble", assembled_kmers);
+
+	return 0;
+}
 
-		if (nt4==4){
-			return -1;
+
+/*
+	Streaming intersection (only -x): the candidate input (the smallest file
+	or --candidates) is loaded into a hash set, the other inputs are
+	streamed past it one by one and the candidates missing in them are
+	removed. The peak memory is about the candidate set.
+*/
+template<typename _nkmer_T>
+int32_t run_streaming_intersection(const params_t &params){
+	int32_t base=params.candidates;
+	if(base<0){
+		base=0;
+		for(int32_t i=1;i<params.no_sets;i++){
+			if(file_size(params.in_fns[i])<file_size(params.in_fns[base])){
+				base=i;
+			}
 		}
+	}
 
-		--l_ext;
-		*l_ext=nt4_nt256[3-nt4];
-		return 0;
+	if(params.verbose){
+		std::cerr << "=====================" << std::endl;
+		std::cerr << "1) Loading candidates" << std::endl;
+		std::cerr << "=====================" << std::endl;
 	}
 
-	~contig_t(){
-		delete[] seq_buffer;
+	phase_timer_t timer;
+	table_stats_t tables;
+	partitioned_kmer_set_t<_nkmer_T> intersection;
+	test_load(load_kmers(params.in_fns[base], intersection, params.k, params.min_count, params.threads, params.verbose), params.in_fns[base], params.k);
+	if(params.fstats){
+		fprintf(params.fstats,"%s\t%lu\n",params.in_fns[base].c_str(),intersection.size());
 	}
+	add_table_stats(intersection, tables);
+	timer.print(params.fstats, "load", intersection.size(), tables);
 
-	bool is_full(){
-		return (r_ext>=r_ext_border) || (l_ext<=l_ext_border);
+	if(params.verbose){
+		std::cerr << "===============================" << std::endl;
+		std::cerr << "2) Intersecting (streaming mode)" << std::endl;
+		std::cerr << "===============================" << std::endl;
 	}
 
-	int32_t print_to_fasta(FILE* fasta_file, const char* contig_name, const char *comment=nullptr) const {
-		if (comment==nullptr){
-			fprintf(fasta_file,">%s\n",contig_name);
-		} else {
-			fprintf(fasta_file,">%s %s\n",contig_name,comment);
+	for(int32_t i=0;i<params.no_sets;i++){
+		if(i==base){
+			continue;
 		}
-
-		char print_buffer[fasta_line_length+1]={0};
-
-		for (char *p=l_ext;p<r_ext;p+=fasta_line_length){
-			strncpy(print_buffer,p,fasta_line_length);
-			fprintf(fasta_file, "%s\n", print_buffer);
+		timer.restart();
+		kmer_filter_t<_nkmer_T> filter(intersection);
+		const bool dump=is_kmer_dump(params.in_fns[i]);
+		test_load(kmers_from_fasta(params.in_fns[i], filter, params.k, params.threads, nullptr, params.verbose), params.in_fns[i], params.k);
+		const size_t no_candidates=intersection.size();
+		filter.filter(dump ? 1 : params.min_count, params.threads);
+		if(params.verbose){
+			std::cerr << "   candidates: " << no_candidates << " -> " << intersection.size() << std::endl;
 		}
+		tables=table_stats_t();
+		add_table_stats(intersection, tables);
+		timer.print(params.fstats, "intersect", no_candidates, tables);
+	}
 
-		return 0;
+	if(params.verbose){
+		std::cerr << "=============" << std::endl;
+		std::cerr << "3) Assembling" << std::endl;
+		std::cerr << "=============" << std::endl;
 	}
-};
 
+	timer.restart();
+	const uint64_t assembled_kmers=intersection.size();
+	assemble_output(params.intersection_fn, intersection, params);
+	timer.print(params.fstats, params.binary_output ? "write" : "assemble", assembled_kmers);
 
-/*
-	TODO: test if kmer is correct
-*/
+	return 0;
+}
 
-//template<typename _nkmer_T, typename _set_T>
-template<typename _set_T>
-int kmers_from_fasta(const std::string &fasta_fn, _set_T &set, int32_t k, FILE* fstats,bool verbose){
 
-	if (verbose){
-		std::cerr << "Loading " << fasta_fn << std::endl;
+/*
+	Colored mode (-c): all inputs are loaded into one colored k-mer table
+	(kmer_colors.h), so k-mers shared by several inputs are stored once.
+	The intersection and the outputs (k-mers of an input not in the
+	intersection) are then extracted by scanning the table, one output set
+	at a time.
+*/
+template<typename _nkmer_T>
+void load_colored(const std::string &fn, partitioned_kmer_color_table_t<_nkmer_T> &table, int32_t color, int32_t k, int32_t min_count, int32_t threads, bool verbose){
+	kmer_color_inserter_t<_nkmer_T> inserter(table, color);
+	if(min_count>1 && !is_kmer_dump(fn)){
+		partitioned_kmer_set_t<_nkmer_T> solid;
+		test_load(solid_kmers_from_fasta(fn, solid, k, min_count, threads, verbose), fn, k);
+		std::vector<kmer_set_t<_nkmer_T> *> solid_partitions(solid.no_partitions());
+		std::vector<kmer_color_table_t<_nkmer_T> *> table_partitions(solid.no_partitions());
+		for(size_t p=0;p<solid_partitions.size();p++){
+			solid_partitions[p]=&solid.partition(p);
+			table_partitions[p]=&inserter.partition(p);
+		}
+		run_tasks(solid_partitions.size(), threads, [&](int32_t p){
+			for(const _nkmer_T &nkmer : *solid_partitions[p]){
+				table_partitions[p]->insert(nkmer);
+			}
+			solid_partitions[p]->clear();
+		});
 	}
+	else{
+		test_load(kmers_from_fasta(fn, inserter, k, threads, nullptr, verbose), fn, k);
+	}
+}
 
+/*
+	K-mers of a colored table whose colors satisfy pred(partition, slot).
+*/
+template<typename _nkmer_T, typename _pred_T>
+void extract_colored(const partitioned_kmer_color_table_t<_nkmer_T> &table, partitioned_kmer_set_t<_nkmer_T> &set, int32_t threads, _pred_T pred){
 	set.clear();
-
-	kseq_t *seq;
-	int64_t l;
-
-	FILE *instream = nullptr;
-	if(fasta_fn=="-"){
-		instream = stdin;
+	std::vector<kmer_set_t<_nkmer_T> *> partitions(set.no_partitions());
+	for(size_t p=0;p<partitions.size();p++){
+		partitions[p]=&set.partition(p);
 	}
-	else {
-		instream = fopen(fasta_fn.c_str(), "r");
-		test_file(instream, fasta_fn);
-	}
-	gzFile fp = gzdopen(fileno(instream), "r");
-	seq = kseq_init(fp);
+	run_tasks(table.no_partitions(), threads, [&](int32_t p){
+		const kmer_color_table_t<_nkmer_T> &part=table.partition(p);
+		kmer_set_t<_nkmer_T> &out=*partitions[p];
+		size_t n=0;
+		for(size_t slot=0;slot<part.capacity();slot++){
+			n+=part.occupied(slot) && pred(part, slot);
+		}
+		out.reserve(n);
+		for(size_t slot=0;slot<part.capacity();slot++){
+			if(part.occupied(slot) && pred(part, slot)){
+				out.insert(part.at(slot));
+			}
+		}
+	});
+}
 
-	typename _set_T::value_type nkmer;
+template<typename _nkmer_T>
+int32_t run_colored(const params_t &params){
+	if(params.verbose){
+		std::cerr << "===================================" << std::endl;
+		std::cerr << "1) Loading references (colored mode)" << std::endl;
+		std::cerr << "===================================" << std::endl;
+	}
 
-	for(int32_t seqid=0;(l = kseq_read(seq)) >= 0;seqid++) {
-		//std::cerr << "kmers from fasta" << std::endl;
+	phase_timer_t timer;
+	table_stats_t tables;
+	partitioned_kmer_color_table_t<_nkmer_T> table(params.no_sets);
+	for(int32_t i=0;i<params.no_sets;i++){
+		load_colored(params.in_fns[i], table, i, params.k, params.min_count, params.threads, params.verbose);
+	}
 
-		//std::cerr << "starting iterator" << std::endl;
-		for(char *kmer=seq->seq.s; kmer < (seq->seq.s) + (seq->seq.l) -k +1 ;kmer++){
-			int c = encode_canonical(kmer, k, nkmer);
-			if (c==0){
-				set.insert(nkmer);
+	std::vector<std::vector<uint64_t>> partition_sizes(table.no_partitions());
+	run_tasks(table.no_partitions(), params.threads, [&](int32_t p){
+		const kmer_color_table_t<_nkmer_T> &part=table.partition(p);
+		std::vector<uint64_t> &sizes=partition_sizes[p];
+		sizes.assign(params.no_sets+1, 0);
+		for(size_t slot=0;slot<part.capacity();slot++){
+			if(!part.occupied(slot)){
+				continue;
 			}
-			else{
-				//std::cerr << "problem" <<std::endl;
+			for(int32_t i=0;i<params.no_sets;i++){
+				sizes[i]+=part.has_color(slot, i);
 			}
+			sizes[params.no_sets]+=part.has_all_colors(slot);
+		}
+	});
+	std::vector<uint64_t> in_sizes(params.no_sets+1, 0);
+	for(const std::vector<uint64_t> &sizes : partition_sizes){
+		for(int32_t i=0;i<=params.no_sets;i++){
+			in_sizes[i]+=sizes[i];
 		}
 	}
 
-	if(fstats){
-		fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+	uint64_t loaded_kmers=0;
+	for(int32_t i=0;i<params.no_sets;i++){
+		if(params.fstats){
+			fprintf(params.fstats,"%s\t%lu\n",params.in_fns[i].c_str(),in_sizes[i]);
+		}
+		loaded_kmers+=in_sizes[i];
+	}
+	add_table_stats(table, tables);
+	timer.print(params.fstats, "load", loaded_kmers, tables);
+	if(params.verbose){
+		std::cerr << "   distinct k-mers: " << table.size() << ", intersection size: " << in_sizes[params.no_sets] << std::endl;
+	}
+
+	if(params.verbose){
+		std::cerr << "==========================" << std::endl;
+		std::cerr << "2) Extracting & assembling" << std::endl;
+		std::cerr << "==========================" << std::endl;
+	}
+
+	const bool subtract=params.compute_intersection;
+	const char *write_phase=params.binary_output ? "write" : "assemble";
+	partitioned_kmer_set_t<_nkmer_T> set;
+	if(params.compute_output){
+		for(int32_t i=0;i<params.no_sets;i++){
+			timer.restart();
+			extract_colored(table, set, params.threads,
+				[&](const kmer_color_table_t<_nkmer_T> &part, size_t slot){
+					return part.has_color(slot, i) && !(subtract && part.has_all_colors(slot));
+				}
+			);
+			assert(set.size()+(subtract ? in_sizes[params.no_sets] : 0)==in_sizes[i]);
+			timer.print(params.fstats, "extract", table.size());
+
+			timer.restart();
+			const uint64_t assembled_kmers=set.size();
+			assemble_output(params.out_fns[i], set, params);
+			timer.print(params.fstats, write_phase, assembled_kmers);
+		}
 	}
-	//std::cerr << "iterator finished" << std::endl;
+	if(params.compute_intersection){
+		timer.restart();
+		extract_colored(table, set, params.threads,
+			[](const kmer_color_table_t<_nkmer_T> &part, size_t slot){
+				return part.has_all_colors(slot);
+			}
+		);
+		timer.print(params.fstats, "extract", table.size());
 
-	kseq_destroy(seq);
-	gzclose(fp);
+		timer.restart();
+		const uint64_t assembled_kmers=set.size();
+		assemble_output(params.intersection_fn, set, params);
+		timer.print(params.fstats, write_phase, assembled_kmers);
+	}
 
 	return 0;
 }
 
-template<typename _set_T>
-int32_t find_intersection(const std::vector<_set_T> &sets, _set_T &intersection){
-	assert(sets.size()>0);
 
-	/*
-		1) Find the smallest set from sets.
-	*/
+/*
+	External memory mode (--max-mem)
+	================================
+
+	1) Every input is streamed once and its k-mers are written to disk into
+	   buckets by minimizer (kmer_buckets.h).
+	2) The buckets are processed one at a time: the k-mer sets of a bucket
+	   are loaded, intersected, subtracted and assembled; the simplitigs
+	   (pieces) are stored in temporary files.
+	3) Pieces of different buckets whose ends overlap by k-1 nucleotides
+	   are stitched together and the resulting simplitigs are written out.
+
+	The number of buckets is chosen so that the sets of a single bucket fit
+	into --max-mem.
+*/
 
-	int32_t min=std::numeric_limits<int32_t>::max();
-	int32_t i_min=-1;
+/* maximum number of buckets (one open file per bucket while loading) */
+const int32_t max_external_buckets=512;
 
-	//std::cerr << "searching min" << std::endl;
+/* bucket files are written with buffers of this size */
+const int64_t external_bucket_buffer_size=kmer_bucket_writer_t<uint64_t>::buffer_length*sizeof(uint64_t);
 
-	for(int32_t i=0;i<static_cast<int32_t>(sets.size());i++){
-		if (static_cast<int32_t>(sets[i].size())<min){
-			min=sets[i].size();
-			i_min=i;
-			//std::cerr << "new min" << i << std::endl;
+/*
+	Upper bound on the number of k-mers of an input (one per byte of FASTA,
+	four per byte of gzipped FASTA).
+*/
+double estimate_no_kmers(const std::string &fn){
+	if(is_kmer_dump(fn)){
+		FILE *file=fopen(fn.c_str(), "rb");
+		kmer_dump_header_t header;
+		const bool ok=file!=nullptr && fread(&header, sizeof(header), 1, file)==1;
+		if(file!=nullptr){
+			fclose(file);
 		}
+		return ok ? header.count : 0;
 	}
 
-	assert(i_min != std::numeric_limits<int32_t>::max() && i_min!=-1);
+	const double size=file_size(fn);
+	FILE *file=fopen(fn.c_str(), "rb");
+	if(file==nullptr){
+		return size;
+	}
+	uint8_t magic[2]={0, 0};
+	const bool gzip=fread(magic, 1, 2, file)==2 && magic[0]==0x1f && magic[1]==0x8b;
+	fclose(file);
+	return gzip ? 4*size : size;
+}
 
-	/*
-		2) Take it as the intersection.
-	*/
+/*
+	The smallest power of two of buckets such that the sets of a bucket
+	(about 3 words per k-mer in a hash table, plus the intersection) fit
+	into max_mem.
+*/
+int32_t external_no_buckets(const params_t &params, size_t word_size){
+	double no_kmers=0.0;
+	double min_kmers=std::numeric_limits<double>::max();
+	for(const std::string &fn : params.in_fns){
+		const double n=estimate_no_kmers(fn);
+		no_kmers+=n;
+		min_kmers=std::min(min_kmers, n);
+	}
+	if(params.compute_intersection){
+		no_kmers+=min_kmers;
+	}
 
-	//std::cerr << "2" << std::endl;
+	const double memory=3.0*word_size*no_kmers;
+	int32_t no_buckets=1;
+	while(no_buckets<max_external_buckets
+		&& memory/no_buckets + no_buckets*external_bucket_buffer_size > params.max_mem)
+	{
+		no_buckets*=2;
+	}
+	if(memory/no_buckets > params.max_mem){
+		std::cerr << "Warning: the k-mer sets of a bucket may exceed --max-mem." << std::endl;
+	}
+	return no_buckets;
+}
 
-	intersection.clear();
-	//std::cerr << "2.1" << std::endl;
-	std::copy(
-		sets[i_min].cbegin(), sets[i_min].cend(),
-		std::inserter(intersection,intersection.end())
-	);
+std::string make_temp_dir(){
+	const char *tmp=getenv("TMPDIR");
+	const std::string pattern=std::string(tmp!=nullptr && tmp[0]!='\0' ? tmp : "/tmp")+"/prophasm.XXXXXX";
+	std::vector<char> dir(pattern.begin(), pattern.end());
+	dir.push_back('\0');
+	if(mkdtemp(dir.data())==nullptr){
+		std::cerr << "Error: temporary directory '" << pattern << "' could not be created (error " << errno << ", " << strerror(errno) << ")." << std::endl;
+		exit(1);
+	}
+	return std::string(dir.data());
+}
 
-	/*
-		3) Remove elements from intersection present in other sets.
-	*/
 
-	for(const _set_T &current_set : sets) {
+template<typename _nkmer_T, typename _output_T>
+int64_t assemble_simplitigs(sorted_kmer_set_t<_nkmer_T> &set, int32_t k, _output_T output){
+	partitioned_kmer_set_t<_nkmer_T> hash_set;
+	move_to_hash_set(set, hash_set);
+	return assemble_simplitigs(hash_set, k, output);
+}
 
-		for(auto it = intersection.begin(); it !=intersection.end();){
 
-			if(current_set.find(*it) == current_set.cend()){
-				it=intersection.erase(it);
-			}
-			else{
-				++it;
-			}
-		}
+/*
+	Load a bucket of an input.
+*/
+template<typename _nkmer_T>
+void kmers_from_bucket(const std::string &fn, partitioned_kmer_set_t<_nkmer_T> &set, int32_t /*k*/, int32_t min_count, int32_t threads){
+	bool ok;
+	if(min_count>1){
+		partitioned_kmer_counter_t<_nkmer_T> counter;
+		ok=read_kmer_bucket<_nkmer_T>(fn, [&](const _nkmer_T &nkmer){ counter.insert(nkmer); });
+		solid_kmers(counter, set, min_count, threads);
 	}
-
-	return 0;
+	else{
+		ok=read_kmer_bucket<_nkmer_T>(fn, [&](const _nkmer_T &nkmer){ set.insert(nkmer); });
+	}
+	if(!ok){
+		std::cerr << "Error: temporary file '" << fn << "' could not be read." << std::endl;
+		exit(1);
+	}
+	unlink(fn.c_str());
 }
 
+template<typename _nkmer_T>
+void kmers_from_bucket(const std::string &fn, sorted_kmer_set_t<_nkmer_T> &set, int32_t k, int32_t min_count, int32_t threads){
+	bool ok;
+	if(min_count>1){
+		partitioned_kmer_counter_t<_nkmer_T> counter;
+		ok=read_kmer_bucket<_nkmer_T>(fn, [&](const _nkmer_T &nkmer){ counter.insert(nkmer); });
+		solid_kmers(counter, set, k, min_count, threads);
+	}
+	else{
+		sorted_kmer_collector_t<_nkmer_T> collector(k);
+		ok=read_kmer_bucket<_nkmer_T>(fn, [&](const _nkmer_T &nkmer){ collector.insert(nkmer); });
+		collector.move_to(set, threads);
+	}
+	if(!ok){
+		std::cerr << "Error: temporary file '" << fn << "' could not be read." << std::endl;
+		exit(1);
+	}
+	unlink(fn.c_str());
+}
 
-template<typename _set_T, typename _subset_T>
-int32_t remove_subset(std::vector<_set_T> &sets, const _subset_T &subset){
 
-	for(int32_t i=0;i<static_cast<int32_t>(sets.size());i++){
+template<typename _nkmer_T, typename _set_T>
+int32_t run_external(const params_t &params){
+	const int32_t no_buckets=external_no_buckets(params, sizeof(_nkmer_T));
+	const int32_t minimizer_length=default_minimizer_length(params.k);
+	const std::string temp_dir=make_temp_dir();
 
-		_set_T &current_set = sets[i];
+	auto bucket_fn=[&](int32_t i, int32_t b){
+		return temp_dir+"/in"+std::to_string(i)+".b"+std::to_string(b);
+	};
 
-		for(const auto &nkmer : subset){
-			current_set.erase(nkmer);
-		}
+	if(params.verbose){
+		std::cerr << "=====================" << std::endl;
+		std::cerr << "1) Loading references" << std::endl;
+		std::cerr << "=====================" << std::endl;
+		std::cerr << "   external memory mode: " << no_buckets << " buckets in " << temp_dir << std::endl;
 	}
 
-	return 0;
-}
+	phase_timer_t timer;
+	uint64_t written_kmers=0;
 
+	/* binary k-mer sets are not filtered by -m */
+	std::vector<int32_t> min_counts(params.no_sets);
+	for(int32_t i=0;i<params.no_sets;i++){
+		min_counts[i]=is_kmer_dump(params.in_fns[i]) ? 1 : params.min_count;
 
-template<typename _set_T>
-int assemble(const std::string &fasta_fn, _set_T &set, int32_t k, FILE* fstats, bool verbose){
-	if(fstats){
-		fprintf(fstats,"%s\t%lu\n",fasta_fn.c_str(),set.size());
+		std::vector<std::string> fns;
+		for(int32_t b=0;b<no_buckets;b++){
+			fns.push_back(bucket_fn(i, b));
+		}
+		kmer_bucket_writer_t<_nkmer_T> writer(fns, params.k, minimizer_length, min_counts[i]<=1);
+		test_load(kmers_from_fasta(params.in_fns[i], writer, params.k, params.threads, nullptr, params.verbose), params.in_fns[i], params.k);
+		written_kmers+=writer.size();
+		if(!writer.close()){
+			std::cerr << "Error: temporary files in '" << temp_dir << "' could not be written (error " << errno << ", " << strerror(errno) << ")." << std::endl;
+			exit(1);
+		}
 	}
 
-	FILE *file=nullptr;
-	if(fasta_fn=="-"){
-		file=stdout;
-	}
-	else{
-		file=fopen(fasta_fn.c_str(),"w+");
-		test_file(file, fasta_fn);
+	if(params.verbose){
+		std::cerr << "=========================================" << std::endl;
+		std::cerr << "2) Intersecting and assembling by buckets" << std::endl;
+		std::cerr << "=========================================" << std::endl;
 	}
-	char kmer_str[max_allowed_kmer_length+1];
-	contig_t contig(k);
-	const std::vector<char> nucls = {'A','C','G','T'};
 
-	//int32_t i=0;
-	int32_t contig_id=1;
-	while(set.size()>0){
-
-		const auto central_nkmer=*(set.begin());
-		set.erase(central_nkmer);
+	timer.print(params.fstats, "partition", written_kmers);
 
-		std::string central_kmer_string;
-		decode_kmer(central_nkmer,k,central_kmer_string);
-		contig.new_contig(central_kmer_string.c_str());
-
-		typename _set_T::value_type nkmer;
+	std::vector< std::unique_ptr< simplitig_pieces_t<_nkmer_T> > > pieces;
+	std::vector<std::string> piece_out_fns;
+	if(params.compute_output){
+		for(int32_t i=0;i<params.no_sets;i++){
+			pieces.emplace_back(new simplitig_pieces_t<_nkmer_T>(params.k, temp_dir+"/out"+std::to_string(i)));
+			piece_out_fns.push_back(params.out_fns[i]);
+		}
+	}
+	if(params.compute_intersection){
+		pieces.emplace_back(new simplitig_pieces_t<_nkmer_T>(params.k, temp_dir+"/intersection"));
+		piece_out_fns.push_back(params.intersection_fn);
+	}
 
+	std::vector<uint64_t> in_sizes(params.no_sets, 0);
+	std::vector<uint64_t> out_sizes(pieces.size(), 0);
 
-		for (int direction=0;direction<2;direction++){
+	timer.restart();
+	table_stats_t tables;
 
-			//std::cerr << "direction " << direction << std::endl;
+	for(int32_t b=0;b<no_buckets;b++){
+		std::vector<_set_T> sets(params.no_sets);
+		for(int32_t i=0;i<params.no_sets;i++){
+			kmers_from_bucket(bucket_fn(i, b), sets[i], params.k, min_counts[i], params.threads);
+			in_sizes[i]+=sets[i].size();
+			add_table_stats(sets[i], tables);
+		}
 
-			if (direction==0){
-				// forward
+		_set_T intersection;
+		if(params.compute_intersection){
+			if(params.compute_output){
+				extract_intersection(sets, intersection, params.threads);
 			}
 			else{
-				// reverse
-				reverse_complement_in_place(central_kmer_string);
+				find_intersection(sets, intersection, params.threads);
 			}
+		}
 
-			strncpy(kmer_str,central_kmer_string.c_str(),k);
-			kmer_str[k]='\0';
-
-			bool extending = true;
+		std::vector<_set_T *> out_sets;
+		if(params.compute_output){
+			for(int32_t i=0;i<params.no_sets;i++){
+				out_sets.push_back(&sets[i]);
+			}
+		}
+		if(params.compute_intersection){
+			out_sets.push_back(&intersection);
+		}
 
-			//std::cerr << "central k-mer: " << central_kmer_string << std::endl;
+		for(size_t j=0;j<out_sets.size();j++){
+			out_sizes[j]+=out_sets[j]->size();
+			assemble_simplitigs(*out_sets[j], params.k, [&](const char *seq, size_t len){ pieces[j]->add(seq, len); });
+		}
+	}
 
+	if(params.verbose){
+		std::cerr << "============" << std::endl;
+		std::cerr << "3) Stitching" << std::endl;
+		std::cerr << "============" << std::endl;
+	}
 
-			while (extending){
-				for(int32_t i=0;i<k;i++){
-					kmer_str[i]=kmer_str[i+1];
-				}
-				kmer_str[k]='\0';
+	if(params.fstats){
+		for(int32_t i=0;i<params.no_sets;i++){
+			fprintf(params.fstats,"%s\t%lu\n",params.in_fns[i].c_str(),in_sizes[i]);
+		}
+	}
+	timer.print(params.fstats, "buckets", std::accumulate(in_sizes.begin(), in_sizes.end(), uint64_t(0)), tables);
+	timer.restart();
 
-				extending=false;
-				for(const char &c : nucls){
-					kmer_str[k-1]=c;
+	output_format_t format;
+	format.line_length=params.line_length;
+	format.gzip=params.gzip;
+	format.threads=params.threads;
 
-					encode_canonical(kmer_str, k, nkmer);
+	for(size_t j=0;j<pieces.size();j++){
+		if(params.fstats){
+			fprintf(params.fstats,"%s\t%lu\n",piece_out_fns[j].c_str(),out_sizes[j]);
+		}
+		const size_t no_pieces=pieces[j]->size();
+		const int64_t no_contigs=write_stitched(piece_out_fns[j], *pieces[j], params.k, format, params.fstats);
+		if(params.verbose){
+			std::cerr << "   " << piece_out_fns[j] << ": " << no_pieces << " pieces stitched into " << no_contigs << " simplitigs" << std::endl;
+		}
+		pieces[j].reset();
+	}
+	timer.print(params.fstats, "stitch", std::accumulate(out_sizes.begin(), out_sizes.end(), uint64_t(0)));
 
-					if(set.count( nkmer )){
-						//std::cerr << "extending " << c << std::endl;
-						//debug_print_kmer_set(set,k);
-						//std::cerr << std::string(contig.l_ext) << c << std::endl;
-						//std::cerr << std::endl;
-						if(direction==0){
-							contig.r_extend(c);
-						}
-						else{
-							contig.l_extend(c);
-						}
-						set.erase(nkmer);
+	rmdir(temp_dir.c_str());
 
-						if(!contig.is_full()){
-							extending=true;
-						}
-						break;
-					}
-				}
-			}
-		}
+	return 0;
+}
 
-		//std::cerr << "====================" << std::endl;
 
-		std::stringstream ss;
-		ss<<"c"<<contig_id;
-		const std::string contig_name(ss.str());
-		contig.print_to_fasta(file,contig_name.c_str());
-		contig_id++;
+/*
+	Select the container of the k-mer sets.
+*/
+template<typename _nkmer_T>
+int32_t run(const params_t &params){
+	if(params.max_mem>0){
+		if(params.sorted_sets){
+			return run_external< _nkmer_T, sorted_kmer_set_t<_nkmer_T> >(params);
+		}
+		else{
+			return run_external< _nkmer_T, partitioned_kmer_set_t<_nkmer_T> >(params);
+		}
 	}
 
-	fclose(file);
-
-	if(verbose){
-		std::cerr << "   assembly finished (" << contig_id << " contigs)" << std::endl;
+	if(params.colored){
+		return run_colored<_nkmer_T>(params);
 	}
 
-	return 0;
+	if(params.compute_intersection && !params.compute_output){
+		return run_streaming_intersection<_nkmer_T>(params);
+	}
 
+	if(params.sorted_sets){
+		return run_pipeline< _nkmer_T, sorted_kmer_set_t<_nkmer_T> >(params);
+	}
+	else{
+		return run_pipeline< _nkmer_T, partitioned_kmer_set_t<_nkmer_T> >(params);
+	}
 }
 
 
 int main (int argc, char* argv[])
 {
 	int32_t k=-1;
+	int32_t min_count=1;
+	int32_t threads=1;
+	int64_t max_mem=0;
+	int32_t candidates=-1;
+	int32_t line_length=default_fasta_line_length;
 
 	std::string intersection_fn;
 	std::vector<std::string> in_fns;
@@ -562,10 +1744,24 @@ int main (int argc, char* argv[])
 	bool compute_intersection=false;
 	bool compute_output=false;
 	bool verbose=true;
+	bool sorted_sets=false;
+	bool parallel_assembly=false;
+	bool bucketed_assembly=false;
+	bool colored=false;
+	bool gzip=false;
+	bool binary_output=false;
+	bool delta_output=false;
 	int32_t no_sets=0;
 
 	int c;
-	while ((c = getopt(argc, (char *const *)argv, "hSi:o:x:s:k:")) >= 0) {
+	const int32_t opt_max_mem=256;
+	const int32_t opt_candidates=257;
+	static const struct option long_options[]={
+		{"max-mem", required_argument, nullptr, opt_max_mem},
+		{"candidates", required_argument, nullptr, opt_candidates},
+		{nullptr, 0, nullptr, 0}
+	};
+	while ((c = getopt_long(argc, (char *const *)argv, "hSapgczbdi:o:x:s:k:m:t:l:", long_options, nullptr)) >= 0) {
 		switch (c) {
 			case 'h': {
 				print_help();
@@ -604,10 +1800,74 @@ int main (int argc, char* argv[])
 
 				break;
 			}
+			case 'a': {
+				sorted_sets=true;
+
+				break;
+			}
+			case 'p': {
+				parallel_assembly=true;
+
+				break;
+			}
+			case 'g': {
+				bucketed_assembly=true;
+
+				break;
+			}
+			case 'c': {
+				colored=true;
+
+				break;
+			}
+			case 'z': {
+				gzip=true;
+
+				break;
+			}
+			case 'b': {
+				binary_output=true;
+
+				break;
+			}
+			case 'd': {
+				binary_output=true;
+				delta_output=true;
+
+				break;
+			}
 			case 'k': {
 				k = atoi(optarg);
 				break;
 			}
+			case 'm': {
+				min_count = atoi(optarg);
+				break;
+			}
+			case 't': {
+				threads = atoi(optarg);
+				break;
+			}
+			case 'l': {
+				line_length = atoi(optarg);
+				break;
+			}
+			case opt_max_mem: {
+				max_mem = parse_size(optarg);
+				if (max_mem <= 0){
+					std::cerr << "Invalid memory limit '" << optarg << "'." << std::endl;
+					return EXIT_FAILURE;
+				}
+				break;
+			}
+			case opt_candidates: {
+				candidates = atoi(optarg)-1;
+				if (candidates < 0){
+					std::cerr << "Invalid input number '" << optarg << "'." << std::endl;
+					return EXIT_FAILURE;
+				}
+				break;
+			}
 			case '?': {
 				std::cerr<<"Unknown error"<<std::endl;
 				exit(1);
@@ -628,95 +1888,93 @@ int main (int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 
-	if (compute_output && (static_cast<int32_t>(out_fns.size())!=no_sets)){
-		std::cerr << "If -o is used, it must be used as many times as -i (" << no_sets << "!=" << out_fns.size() << ")." << std::endl;
+	if (min_count <= 0 || static_cast<int32_t>(kmer_counter_t<uint64_t>::max_count)<min_count){
+		std::cerr << "Minimum k-mer count must satisfy 1 <= m <= " << static_cast<int32_t>(kmer_counter_t<uint64_t>::max_count) << "." << std::endl;
 		return EXIT_FAILURE;
 	}
 
-	if(fstats){
-		fprintf(fstats,"# cmd: %s",argv[0]);
-
-		for (int32_t i=1;i<argc;i++){
-			fprintf(fstats," %s",argv[i]);
-		}
-		fprintf(fstats,"\n");
+	if (threads <= 0){
+		std::cerr << "Number of threads must be positive." << std::endl;
+		return EXIT_FAILURE;
 	}
 
-	std::vector< std::unordered_set<nkmer_t> > full_sets(no_sets);
-
-	if(verbose){
-		std::cerr << "=====================" << std::endl;
-		std::cerr << "1) Loading references" << std::endl;
-		std::cerr << "=====================" << std::endl;
+	if (line_length < 0){
+		std::cerr << "Line length must be non-negative." << std::endl;
+		return EXIT_FAILURE;
 	}
 
-
-	std::vector<int32_t> in_sizes;
-	std::vector<int32_t> out_sizes;
-
-	for(int32_t i=0;i<no_sets;i++){
-		kmers_from_fasta(in_fns[i],full_sets[i],k,fstats,verbose);
-		//debug_print_kmer_set(full_sets[i],k);
-		in_sizes.insert(in_sizes.end(),full_sets[i].size());
+	if (max_mem > 0 && binary_output){
+		std::cerr << "Binary k-mer sets (-b, -d) cannot be written in the external memory mode (--max-mem)." << std::endl;
+		return EXIT_FAILURE;
 	}
 
-	if(verbose){
-		std::cerr << "===============" << std::endl;
-		std::cerr << "2) Intersecting" << std::endl;
-		std::cerr << "===============" << std::endl;
+	if (colored && (max_mem > 0 || sorted_sets)){
+		std::cerr << "The colored mode (-c) cannot be combined with -a or --max-mem." << std::endl;
+		return EXIT_FAILURE;
 	}
 
+	if (compute_intersection && !compute_output && max_mem == 0 && sorted_sets){
+		std::cerr << "The streaming intersection (-x without -o) cannot be combined with -a." << std::endl;
+		return EXIT_FAILURE;
+	}
 
-	std::unordered_set<nkmer_t> intersection;
+	if (candidates >= no_sets){
+		std::cerr << "Input " << candidates+1 << " of --candidates does not exist (" << no_sets << " inputs)." << std::endl;
+		return EXIT_FAILURE;
+	}
 
-	int32_t intersection_size = 0;
+	if (compute_output && (static_cast<int32_t>(out_fns.size())!=no_sets)){
+		std::cerr << "If -o is used, it must be used as many times as -i (" << no_sets << "!=" << out_fns.size() << ")." << std::endl;
+		return EXIT_FAILURE;
+	}
 
-	if(compute_intersection){
-		if (verbose){
-			std::cerr << "2.1) Computing intersection" << std::endl;
-		}
+	if(fstats){
+		fprintf(fstats,"# cmd: %s",argv[0]);
 
-		find_intersection(full_sets, intersection);
-		intersection_size  = intersection.size();
-		if (verbose){
-			std::cerr << "   intersection size: " <<  intersection_size << std::endl;
-		}
-		if(compute_output){
-			if (verbose){
-				std::cerr << "2.2) Removing this intersection from all kmer sets" << std::endl;
-			}
-			remove_subset(full_sets, intersection);
+		for (int32_t i=1;i<argc;i++){
+			fprintf(fstats," %s",argv[i]);
 		}
+		fprintf(fstats,"\n");
+		print_stats_header(fstats);
 	}
 
-	if(compute_output){
-		for (int32_t i=0;i<no_sets;i++){
-			out_sizes.insert(out_sizes.end(),full_sets[i].size());
-			assert(in_sizes[i]==out_sizes[i]+intersection_size);
-			if (verbose){
-				std::cerr << in_sizes[i] << " " << out_sizes[i] << " ...inter:" << intersection_size << std::endl;
-			}
-		}
-	}
+	params_t params;
+	params.k=k;
+	params.min_count=min_count;
+	params.threads=threads;
+	params.line_length=line_length;
+	params.no_sets=no_sets;
+	params.in_fns=in_fns;
+	params.out_fns=out_fns;
+	params.intersection_fn=intersection_fn;
+	params.fstats=fstats;
+	params.compute_intersection=compute_intersection;
+	params.compute_output=compute_output;
+	params.sorted_sets=sorted_sets;
+	params.parallel_assembly=parallel_assembly;
+	params.bucketed_assembly=bucketed_assembly;
+	params.colored=colored;
+	params.gzip=gzip;
+	params.binary_output=binary_output;
+	params.delta_output=delta_output;
+	params.verbose=verbose;
+	params.max_mem=max_mem;
+	params.candidates=candidates;
 
-	if(verbose){
-		std::cerr << "=============" << std::endl;
-		std::cerr << "3) Assembling" << std::endl;
-		std::cerr << "=============" << std::endl;
+	int32_t error_code;
+	if(k<=32){
+		error_code=run<kmer_word<64>::type>(params);
 	}
-
-	if(compute_output){
-		for(int32_t i=0;i<static_cast<int32_t>(in_fns.size());i++){
-			assemble(out_fns[i], full_sets[i], k, fstats, verbose);
-		}
+	else if(k<=64){
+		error_code=run<kmer_word<128>::type>(params);
 	}
-	if(compute_intersection){
-		assemble(intersection_fn, intersection, k, fstats, verbose);
+	else{
+		error_code=run<kmer_word<256>::type>(params);
 	}
 
 	if (fstats){
 		fclose(fstats);
 	}
 
-	return 0;
+	return error_code;
 }
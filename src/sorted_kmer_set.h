@@ -0,0 +1,466 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	K-mer sets stored as sorted, deduplicated arrays of 2-bit encoded
+	k-mers.
+
+	Intersection and subtraction are computed by linear merges, which
+	stream through memory; the arrays are built by a parallel radix sort.
+*/
+
+#ifndef SORTED_KMER_SET_H
+#define SORTED_KMER_SET_H
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cinttypes>
+#include <vector>
+
+
+template<typename _nkmer_T>
+struct sorted_kmer_set_t{
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+	typedef typename std::vector<_nkmer_T>::const_iterator const_iterator;
+	typedef const_iterator iterator;
+
+	/* sorted, without duplicates */
+	std::vector<_nkmer_T> kmers;
+
+	size_t size() const { return kmers.size(); }
+	bool empty() const { return kmers.empty(); }
+
+	void clear(){
+		std::vector<_nkmer_T>().swap(kmers);
+	}
+
+	size_t count(const _nkmer_T &nkmer) const {
+		return std::binary_search(kmers.begin(), kmers.end(), nkmer) ? 1 : 0;
+	}
+
+	const_iterator begin() const { return kmers.begin(); }
+	const_iterator end() const { return kmers.end(); }
+	const_iterator cbegin() const { return kmers.begin(); }
+	const_iterator cend() const { return kmers.end(); }
+};
+
+
+template<typename _nkmer_T>
+inline uint32_t radix_digit(const _nkmer_T &nkmer, int32_t shift){
+	return static_cast<uint64_t>((nkmer >> shift) & _nkmer_T(0xff));
+}
+
+/*
+	LSD radix sort of src[0..n) by the bits [0, bits), 8 bits per pass; dst
+	is a buffer of the same size. The result is stored in src.
+*/
+template<typename _nkmer_T>
+void radix_sort_lsd(_nkmer_T *src, _nkmer_T *dst, size_t n, int32_t bits){
+	if(n<64){
+		std::sort(src, src+n);
+		return;
+	}
+
+	_nkmer_T *from=src;
+	_nkmer_T *to=dst;
+	for(int32_t shift=0;shift<bits;shift+=8){
+		std::array<size_t,256> offsets;
+		offsets.fill(0);
+		for(size_t i=0;i<n;i++){
+			offsets[radix_digit(from[i], shift)]++;
+		}
+		size_t sum=0;
+		for(size_t &o : offsets){
+			const size_t c=o;
+			o=sum;
+			sum+=c;
+		}
+		for(size_t i=0;i<n;i++){
+			to[offsets[radix_digit(from[i], shift)]++]=from[i];
+		}
+		std::swap(from, to);
+	}
+
+	if(from!=src){
+		std::copy(from, from+n, src);
+	}
+}
+
+/*
+	Sort 2k-bit k-mers. A parallel MSD pass distributes them by their highest
+	8 bits into 256 buckets, which are then sorted independently by LSD
+	passes over the remaining bits.
+*/
+template<typename _nkmer_T>
+void radix_sort_kmers(std::vector<_nkmer_T> &kmers, int32_t k, int32_t threads){
+	const size_t n=kmers.size();
+	const int32_t msd_shift=2*k-8;
+	if(msd_shift<=0 || n<(1<<16)){
+		std::sort(kmers.begin(), kmers.end());
+		return;
+	}
+
+	const int32_t no_chunks=std::max(1, threads);
+	auto chunk_begin=[&](int32_t t){ return n*t/no_chunks; };
+
+	std::vector< std::array<size_t,256> > counts(no_chunks);
+	run_tasks(no_chunks, threads, [&](int32_t t){
+		counts[t].fill(0);
+		for(size_t i=chunk_begin(t);i<chunk_begin(t+1);i++){
+			counts[t][radix_digit(kmers[i], msd_shift)]++;
+		}
+	});
+
+	std::vector<size_t> bucket_begin(257);
+	size_t sum=0;
+	for(int32_t b=0;b<256;b++){
+		bucket_begin[b]=sum;
+		for(int32_t t=0;t<no_chunks;t++){
+			const size_t c=counts[t][b];
+			counts[t][b]=sum;
+			sum+=c;
+		}
+	}
+	bucket_begin[256]=sum;
+
+	std::vector<_nkmer_T> buffer(n);
+	run_tasks(no_chunks, threads, [&](int32_t t){
+		for(size_t i=chunk_begin(t);i<chunk_begin(t+1);i++){
+			buffer[counts[t][radix_digit(kmers[i], msd_shift)]++]=kmers[i];
+		}
+	});
+
+	buffer.swap(kmers);
+	run_tasks(256, threads, [&](int32_t b){
+		const size_t s=bucket_begin[b];
+		radix_sort_lsd(kmers.data()+s, buffer.data()+s, bucket_begin[b+1]-s, msd_shift);
+	});
+}
+
+/*
+	Build a sorted set from any container of k-mers.
+*/
+template<typename _nkmer_T, typename _set_T>
+void sorted_kmer_set_from(const _set_T &set, sorted_kmer_set_t<_nkmer_T> &sorted_set, int32_t k, int32_t threads){
+	std::vector<_nkmer_T> kmers(set.begin(), set.end());
+	radix_sort_kmers(kmers, k, threads);
+	kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+	sorted_set.kmers.swap(kmers);
+}
+
+
+/*
+	Collection of a stream of k-mers into a sorted set without a hash table.
+
+	The k-mers are distributed by their highest 8 bits into 256 runs, so
+	that the concatenation of the runs is sorted. Every run keeps a sorted,
+	deduplicated prefix; new k-mers are appended after it and, once there are
+	enough of them, sorted, deduplicated and merged into the prefix.
+
+	sorted_kmer_collector_t has the interface of a partitioned set (the runs
+	are its partitions), so that all loaders can fill it directly.
+*/
+template<typename _nkmer_T>
+class sorted_kmer_collector_t{
+public:
+	typedef _nkmer_T key_type;
+	typedef _nkmer_T value_type;
+	typedef size_t size_type;
+
+	/* minimal number of appended k-mers merged at once */
+	static const size_t min_merge_length=1<<12;
+
+	class run_t{
+	public:
+		run_t(): sorted(0) {}
+
+		/* Append a k-mer; return true (duplicates are removed by merges). */
+		bool insert(const _nkmer_T &nkmer){
+			if(kmers.size()==kmers.capacity()){
+				/* grow by 1/4 rather than 2x, the runs hold all k-mers */
+				kmers.reserve(kmers.size()+kmers.size()/4+min_merge_length);
+			}
+			kmers.push_back(nkmer);
+			if(kmers.size()-sorted>=std::max(min_merge_length, sorted/4)){
+				merge();
+			}
+			return true;
+		}
+
+		/* Merge the appended k-mers into the sorted prefix. */
+		void merge(){
+			const auto middle=kmers.begin()+sorted;
+			std::sort(middle, kmers.end());
+			const auto end=std::unique(middle, kmers.end());
+			std::inplace_merge(kmers.begin(), middle, end);
+			kmers.erase(std::unique(kmers.begin(), end), kmers.end());
+			sorted=kmers.size();
+		}
+
+	private:
+		friend class sorted_kmer_collector_t;
+		std::vector<_nkmer_T> kmers;
+		size_t sorted;
+	};
+
+	typedef run_t partition_type;
+
+	sorted_kmer_collector_t(int32_t k):
+		runs(256), shift(std::max(0, 2*k-8))
+	{}
+
+	size_t no_partitions() const { return runs.size(); }
+	run_t &partition(size_t r){ return runs[r]; }
+
+	size_t partition_of(const _nkmer_T &nkmer) const {
+		return radix_digit(nkmer, shift);
+	}
+
+	bool insert(const _nkmer_T &nkmer){
+		return runs[partition_of(nkmer)].insert(nkmer);
+	}
+
+	/* Number of collected k-mers (the unmerged ones with duplicates). */
+	size_t size() const {
+		size_t s=0;
+		for(const run_t &run : runs){
+			s+=run.kmers.size();
+		}
+		return s;
+	}
+
+	/* The runs grow as needed; reserve() does nothing. */
+	void reserve(size_t){}
+
+	void clear(){
+		for(run_t &run : runs){
+			std::vector<_nkmer_T>().swap(run.kmers);
+			run.sorted=0;
+		}
+	}
+
+	/* Move the k-mers to a sorted set; the collector is left empty. */
+	void move_to(sorted_kmer_set_t<_nkmer_T> &set, int32_t threads){
+		run_tasks(runs.size(), threads, [&](int32_t r){
+			runs[r].merge();
+		});
+
+		set.clear();
+		set.kmers.reserve(size());
+		for(run_t &run : runs){
+			set.kmers.insert(set.kmers.end(), run.kmers.begin(), run.kmers.end());
+			std::vector<_nkmer_T>().swap(run.kmers);
+			run.sorted=0;
+		}
+	}
+
+private:
+	std::vector<run_t> runs;
+	int32_t shift;
+};
+
+/*
+	Intersection by a multi-way merge driven by the smallest set. Its range
+	is split into as many parts as threads; the other sets are positioned
+	at the beginning of each part by binary search.
+*/
+template<typename _nkmer_T>
+int32_t sorted_intersection(const std::vector< sorted_kmer_set_t<_nkmer_T> > &sets, sorted_kmer_set_t<_nkmer_T> &intersection, int32_t threads){
+	assert(sets.size()>0);
+
+	size_t i_min=0;
+	for(size_t i=1;i<sets.size();i++){
+		if(sets[i].size()<sets[i_min].size()){
+			i_min=i;
+		}
+	}
+	const std::vector<_nkmer_T> &smallest=sets[i_min].kmers;
+
+	const int32_t no_parts=std::max(1, threads);
+	std::vector< std::vector<_nkmer_T> > parts(no_parts);
+
+	run_tasks(no_parts, threads, [&](int32_t t){
+		const size_t begin=smallest.size()*t/no_parts;
+		const size_t end=smallest.size()*(t+1)/no_parts;
+		if(begin==end){
+			return;
+		}
+
+		std::vector<typename std::vector<_nkmer_T>::const_iterator> its;
+		for(const sorted_kmer_set_t<_nkmer_T> &set : sets){
+			its.push_back(std::lower_bound(set.kmers.begin(), set.kmers.end(), smallest[begin]));
+		}
+
+		for(size_t i=begin;i<end;i++){
+			const _nkmer_T &nkmer=smallest[i];
+			bool in_all=true;
+			for(size_t j=0;j<sets.size();j++){
+				while(its[j]!=sets[j].kmers.end() && *its[j]<nkmer){
+					++its[j];
+				}
+				if(its[j]==sets[j].kmers.end() || *its[j]!=nkmer){
+					in_all=false;
+					break;
+				}
+			}
+			if(in_all){
+				parts[t].push_back(nkmer);
+			}
+		}
+	});
+
+	intersection.clear();
+	for(const std::vector<_nkmer_T> &part : parts){
+		intersection.kmers.insert(intersection.kmers.end(), part.begin(), part.end());
+	}
+
+	return 0;
+}
+
+/*
+	Remove a subset from all sets by in-place merges (one set per thread).
+*/
+template<typename _nkmer_T>
+int32_t sorted_remove_subset(std::vector< sorted_kmer_set_t<_nkmer_T> > &sets, const sorted_kmer_set_t<_nkmer_T> &subset, int32_t threads){
+	run_tasks(sets.size(), threads, [&](int32_t i){
+		std::vector<_nkmer_T> &kmers=sets[i].kmers;
+		auto it_sub=subset.kmers.begin();
+		size_t j=0;
+		for(const _nkmer_T &nkmer : kmers){
+			while(it_sub!=subset.kmers.end() && *it_sub<nkmer){
+				++it_sub;
+			}
+			if(it_sub==subset.kmers.end() || *it_sub!=nkmer){
+				kmers[j++]=nkmer;
+			}
+		}
+		kmers.resize(j);
+		kmers.shrink_to_fit();
+	});
+
+	return 0;
+}
+
+/*
+	Fused intersection and subtraction of sorted sets: one multi-way merge
+	moves the k-mers present in all sets into intersection and compacts the
+	sets at the same time. As in sorted_intersection, the range of the
+	smallest set is split into parts processed in parallel; every part is
+	compacted in place and the gaps between the parts are closed afterwards.
+*/
+template<typename _nkmer_T>
+int32_t sorted_extract_intersection(std::vector< sorted_kmer_set_t<_nkmer_T> > &sets, sorted_kmer_set_t<_nkmer_T> &intersection, int32_t threads){
+	assert(sets.size()>0);
+
+	size_t i_min=0;
+	for(size_t i=1;i<sets.size();i++){
+		if(sets[i].size()<sets[i_min].size()){
+			i_min=i;
+		}
+	}
+	const std::vector<_nkmer_T> &smallest=sets[i_min].kmers;
+
+	/* part t covers [part_begin[j][t], part_begin[j][t+1]) of set j */
+	const int32_t no_parts=std::max<int32_t>(1, std::min<size_t>(threads, smallest.size()));
+	std::vector< std::vector<size_t> > part_begin(sets.size(), std::vector<size_t>(no_parts+1));
+	for(size_t j=0;j<sets.size();j++){
+		const std::vector<_nkmer_T> &kmers=sets[j].kmers;
+		part_begin[j][0]=0;
+		for(int32_t t=1;t<no_parts;t++){
+			const _nkmer_T &pivot=smallest[smallest.size()*t/no_parts];
+			part_begin[j][t]=std::lower_bound(kmers.begin(), kmers.end(), pivot)-kmers.begin();
+		}
+		part_begin[j][no_parts]=kmers.size();
+	}
+
+	std::vector< std::vector<_nkmer_T> > parts(no_parts);
+	/* number of k-mers kept in every part of every set */
+	std::vector< std::vector<size_t> > part_kept(sets.size(), std::vector<size_t>(no_parts));
+
+	run_tasks(no_parts, threads, [&](int32_t t){
+		std::vector<size_t> read(sets.size());
+		std::vector<size_t> write(sets.size());
+		for(size_t j=0;j<sets.size();j++){
+			read[j]=write[j]=part_begin[j][t];
+		}
+
+		for(size_t i=part_begin[i_min][t];i<part_begin[i_min][t+1];i++){
+			const _nkmer_T nkmer=smallest[i];
+			bool in_all=true;
+			for(size_t j=0;j<sets.size();j++){
+				std::vector<_nkmer_T> &kmers=sets[j].kmers;
+				while(read[j]<part_begin[j][t+1] && kmers[read[j]]<nkmer){
+					kmers[write[j]++]=kmers[read[j]++];
+				}
+				if(read[j]==part_begin[j][t+1] || kmers[read[j]]!=nkmer){
+					in_all=false;
+				}
+			}
+			if(in_all){
+				parts[t].push_back(nkmer);
+				for(size_t j=0;j<sets.size();j++){
+					read[j]++;
+				}
+			}
+		}
+
+		for(size_t j=0;j<sets.size();j++){
+			std::vector<_nkmer_T> &kmers=sets[j].kmers;
+			while(read[j]<part_begin[j][t+1]){
+				kmers[write[j]++]=kmers[read[j]++];
+			}
+			part_kept[j][t]=write[j]-part_begin[j][t];
+		}
+	});
+
+	run_tasks(sets.size(), threads, [&](int32_t j){
+		std::vector<_nkmer_T> &kmers=sets[j].kmers;
+		size_t size=part_kept[j][0];
+		for(int32_t t=1;t<no_parts;t++){
+			std::copy(kmers.begin()+part_begin[j][t], kmers.begin()+part_begin[j][t]+part_kept[j][t], kmers.begin()+size);
+			size+=part_kept[j][t];
+		}
+		kmers.resize(size);
+		kmers.shrink_to_fit();
+	});
+
+	intersection.clear();
+	for(const std::vector<_nkmer_T> &part : parts){
+		intersection.kmers.insert(intersection.kmers.end(), part.begin(), part.end());
+	}
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,167 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Instrumentation written to the -s statistics file. Besides the
+	original "<file>\t<number of k-mers>" lines, the file contains
+	tab-separated records starting with '#' (so that they are skipped by
+	readers of the original format):
+
+		# phase  name  wall_s  cpu_s  peak_rss_kb  kmers  kmers_per_s  load_factor  probe_lengths
+		# output  file  kmers  contigs  length  n50
+
+	probe_lengths is the histogram of the distances of the elements of the
+	hash tables from their home slots (comma-separated counts for the
+	distances 0, 1, 2, ...). load_factor and probe_lengths are "-" for
+	phases without hash tables (or with sorted arrays). CPU time is summed
+	over all threads; peak RSS is the maximum since the start of the
+	program.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+
+inline double wall_time(){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* User and system time of all threads of the process. */
+inline double cpu_time(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec+usage.ru_stime.tv_sec+(usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)*1e-6;
+}
+
+inline int64_t peak_rss_kb(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+
+/*
+	Occupancy of hash tables; several tables can be accumulated.
+*/
+struct table_stats_t{
+	uint64_t size;
+	uint64_t capacity;
+	std::vector<uint64_t> probe_lengths;
+
+	table_stats_t(): size(0), capacity(0) {}
+};
+
+
+inline void print_stats_header(FILE *fstats){
+	if(fstats){
+		fprintf(fstats,"# phase\tname\twall_s\tcpu_s\tpeak_rss_kb\tkmers\tkmers_per_s\tload_factor\tprobe_lengths\n");
+		fprintf(fstats,"# output\tfile\tkmers\tcontigs\tlength\tn50\n");
+	}
+}
+
+
+/*
+	Wall and CPU time of a phase, measured from construction (or restart())
+	until print().
+*/
+class phase_timer_t{
+public:
+	phase_timer_t(){
+		restart();
+	}
+
+	void restart(){
+		wall_start=wall_time();
+		cpu_start=cpu_time();
+	}
+
+	void print(FILE *fstats, const char *name, uint64_t kmers, const table_stats_t &tables=table_stats_t()) const {
+		if(!fstats){
+			return;
+		}
+		const double wall=wall_time()-wall_start;
+		const double cpu=cpu_time()-cpu_start;
+		fprintf(fstats,"# phase\t%s\t%.3f\t%.3f\t%" PRId64 "\t%" PRIu64 "\t%.0f\t",
+			name, wall, cpu, peak_rss_kb(), kmers, wall>0 ? kmers/wall : 0.0);
+		if(tables.capacity>0){
+			fprintf(fstats,"%.3f\t",static_cast<double>(tables.size)/tables.capacity);
+			for(size_t d=0;d<tables.probe_lengths.size();d++){
+				fprintf(fstats,"%s%" PRIu64,d>0 ? "," : "",tables.probe_lengths[d]);
+			}
+			fprintf(fstats,"\n");
+		}
+		else{
+			fprintf(fstats,"-\t-\n");
+		}
+	}
+
+private:
+	double wall_start;
+	double cpu_start;
+};
+
+
+/*
+	Statistics of an assembled output; lengths are the lengths of its
+	contigs (simplitigs), each of them containing length-k+1 k-mers.
+*/
+inline void print_output_stats(FILE *fstats, const std::string &fn, int32_t k, std::vector<uint64_t> lengths){
+	if(!fstats){
+		return;
+	}
+	uint64_t length=0;
+	for(uint64_t l : lengths){
+		length+=l;
+	}
+	const uint64_t kmers=length-lengths.size()*(k-1);
+
+	std::sort(lengths.begin(), lengths.end(), std::greater<uint64_t>());
+	uint64_t n50=0;
+	uint64_t cumulative=0;
+	for(uint64_t l : lengths){
+		cumulative+=l;
+		if(2*cumulative>=length){
+			n50=l;
+			break;
+		}
+	}
+	fprintf(fstats,"# output\t%s\t%" PRIu64 "\t%zu\t%" PRIu64 "\t%" PRIu64 "\n",
+		fn.c_str(), kmers, lengths.size(), length, n50);
+}
+
+#endif
@@ -0,0 +1,142 @@
+/*
+	The MIT License
+
+	Copyright (c) 2016-2017 Karel Brinda <kbrinda@hsph.harvard.edu>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files (the
+	"Software"), to deal in the Software without restriction, including
+	without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to
+	permit persons to whom the Software is furnished to do so, subject to
+	the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+	BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+	ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+	CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+/*
+
+Description:
+
+	Test of libprophasm: the first input is loaded from a file, the second
+	one is parsed here and passed as sequences; the intersection is
+	computed, subtracted and all sets are assembled to FASTA files. Errors
+	(an invalid k, a missing or corrupted input) must be returned.
+
+	Usage: test_library <k> <in1.fa> <in2.fa> <out1.fa> <out2.fa> <intersect.fa> <corrupted.fa.gz>
+*/
+
+#include "../../src/libprophasm.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+
+int32_t write_simplitigs(const std::string &fn, prophasm::kmer_set_t &set){
+	FILE *file=fopen(fn.c_str(), "w");
+	if(file==nullptr){
+		return -1;
+	}
+	int64_t contig_id=1;
+	prophasm::assemble(set, [&](const char *seq, size_t len){
+		fprintf(file, ">c%ld\n", static_cast<long>(contig_id++));
+		fwrite(seq, 1, len, file);
+		fprintf(file, "\n");
+	});
+	fclose(file);
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	if(argc!=8){
+		std::cerr << "Usage: test_library <k> <in1.fa> <in2.fa> <out1.fa> <out2.fa> <intersect.fa> <corrupted.fa.gz>" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const int32_t k=atoi(argv[1]);
+
+	std::vector<prophasm::kmer_set_t> sets;
+	sets.emplace_back(k);
+	sets.emplace_back(k);
+
+	if(prophasm::kmers_from_fasta(argv[2], sets[0], 2)!=0){
+		std::cerr << "Error: " << argv[2] << " could not be loaded." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ifstream in(argv[3]);
+	std::string line, seq;
+	while(std::getline(in, line)){
+		if(!line.empty() && line[0]=='>'){
+			sets[1].add_sequence(seq);
+			seq.clear();
+		}
+		else{
+			seq+=line;
+		}
+	}
+	sets[1].add_sequence(seq);
+
+	prophasm::kmer_set_t intersection(k);
+	if(prophasm::find_intersection(sets, intersection, 2)!=0 || prophasm::remove_subset(sets, intersection, 2)!=0){
+		std::cerr << "Error: set operations failed." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	/* the sets must be disjoint now */
+	prophasm::kmer_set_t x(k);
+	if(prophasm::find_intersection(sets, x)!=0 || x.size()!=0){
+		std::cerr << "Error: the intersection was not removed." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	/* sets with different k are rejected */
+	prophasm::kmer_set_t other(k+1);
+	if(prophasm::remove_subset(sets, other)!=prophasm::PROPHASM_DIFFERENT_K){
+		std::cerr << "Error: sets with different k were not rejected." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	/* invalid k */
+	for(int32_t bad_k : {0, prophasm::max_kmer_length+1}){
+		prophasm::kmer_set_t bad(bad_k);
+		if(bad.valid() || bad.add_sequence("ACGT")!=prophasm::PROPHASM_INVALID_K ||
+			prophasm::kmers_from_fasta(argv[2], bad)!=prophasm::PROPHASM_INVALID_K ||
+			prophasm::assemble(bad, [](const char *, size_t){})!=prophasm::PROPHASM_INVALID_K){
+			std::cerr << "Error: k=" << bad_k << " was not rejected." << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* missing and corrupted inputs */
+	prophasm::kmer_set_t failed(k);
+	if(prophasm::kmers_from_fasta("_missing.fa", failed)!=prophasm::PROPHASM_CANNOT_OPEN){
+		std::cerr << "Error: a missing input was not reported." << std::endl;
+		return EXIT_FAILURE;
+	}
+	const int32_t error_code=prophasm::kmers_from_fasta(argv[7], failed, 2);
+	if(error_code!=prophasm::PROPHASM_CORRUPTED || failed.size()!=0){
+		std::cerr << "Error: a corrupted input was not reported (" << prophasm::error_message(error_code) << ")." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cerr << "sizes: " << sets[0].size() << " " << sets[1].size() << " " << intersection.size() << std::endl;
+
+	if(write_simplitigs(argv[4], sets[0])!=0 || write_simplitigs(argv[5], sets[1])!=0 || write_simplitigs(argv[6], intersection)!=0){
+		std::cerr << "Error: output files could not be written." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return 0;
+}
@@ -91,3 +91,6 @@ print(out1 - in1)
 print()
 print("out2 - in2")
 print(out2 - in2)
+
+if in1 & in2 != inter or s1 != s2 or out1 - in1 or out2 - in2:
+    sys.exit(1)